@@ -47,155 +47,606 @@
 #include "gstomx_audiosink.h"
 #include "gstomx_videosink.h"
 #include "gstomx_filereadersrc.h"
+#include "gstomx_registry.h"
+#include "gstomx_util.h"
 
 #include "config.h"
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 GST_DEBUG_CATEGORY (gstomx_debug);
 
 #define DEFAULT_RANK GST_RANK_PRIMARY
 
-static gboolean
-plugin_init (GstPlugin *plugin)
-{
-    GST_DEBUG_CATEGORY_INIT (gstomx_debug, "omx", 0, "OpenMAX");
+/* What is built in; a configuration file can change it. */
 
-    g_omx_init ();
+typedef struct
+{
+    const gchar *name;
+    const gchar *component;
+    guint rank;
+    GType (*get_type) (void);
+} Builtin;
+
+/** An element to register. */
+typedef struct
+{
+    const gchar *name;
+    const Builtin *type; /**< What it's made of. */
+    const gchar *library;
+    const gchar *component;
+    const gchar *role; /**< NULL to leave the component alone. */
+    guint rank;
+    const gchar *sink_caps; /**< Replace the pad templates; NULL keeps them. */
+    const gchar *src_caps;
+} Descriptor;
+
+static GQuark descriptor_quark;
+
+static const Builtin builtins[] =
+{
+    { "omx_dummy",         "OMX.st.dummy",                    GST_RANK_NONE, gst_omx_dummy_get_type },
+    { "omx_mpeg4dec",      "OMX.st.video_decoder.mpeg4",      DEFAULT_RANK,  gst_omx_mpeg4dec_get_type },
+    { "omx_h263dec",       "OMX.st.video_decoder.h263",       DEFAULT_RANK,  gst_omx_h263dec_get_type },
+    { "omx_h264dec",       "OMX.st.video_decoder.avc",        DEFAULT_RANK,  gst_omx_h264dec_get_type },
+    { "omx_wmvdec",        "OMX.st.video_decoder.wmv",        DEFAULT_RANK,  gst_omx_wmvdec_get_type },
+    { "omx_mpeg4enc",      "OMX.st.video_encoder.mpeg4",      DEFAULT_RANK,  gst_omx_mpeg4enc_get_type },
+    { "omx_avcenc",        "OMX.st.video_encoder.avc",        DEFAULT_RANK,  gst_omx_avcenc_get_type },
+    { "omx_h263enc",       "OMX.st.video_encoder.h263",       DEFAULT_RANK,  gst_omx_h263enc_get_type },
+    { "omx_vorbisdec",     "OMX.st.audio_decoder.ogg.single", DEFAULT_RANK,  gst_omx_vorbisdec_get_type },
+    { "omx_mp3dec",        "OMX.st.audio_decoder.mp3.mad",    DEFAULT_RANK,  gst_omx_mp3dec_get_type },
+    { "omx_amrnbdec",      "OMX.st.audio_decoder.amrnb",      DEFAULT_RANK,  gst_omx_amrnbdec_get_type },
+    { "omx_amrnbenc",      "OMX.st.audio_encoder.amrnb",      DEFAULT_RANK,  gst_omx_amrnbenc_get_type },
+    { "omx_amrwbdec",      "OMX.st.audio_decoder.amrwb",      DEFAULT_RANK,  gst_omx_amrwbdec_get_type },
+    { "omx_amrwbenc",      "OMX.st.audio_encoder.amrwb",      DEFAULT_RANK,  gst_omx_amrwbenc_get_type },
+    { "omx_aacdec",        "OMX.st.audio_decoder.aac",        DEFAULT_RANK,  gst_omx_aacdec_get_type },
+    { "omx_aacenc",        "OMX.st.audio_encoder.aac",        DEFAULT_RANK,  gst_omx_aacenc_get_type },
+    { "omx_adpcmdec",      "OMX.st.audio_decoder.adpcm",      DEFAULT_RANK,  gst_omx_adpcmdec_get_type },
+    { "omx_adpcmenc",      "OMX.st.audio_encoder.adpcm",      DEFAULT_RANK,  gst_omx_adpcmenc_get_type },
+    { "omx_g711dec",       "OMX.st.audio_decoder.g711",       DEFAULT_RANK,  gst_omx_g711dec_get_type },
+    { "omx_g711enc",       "OMX.st.audio_encoder.g711",       DEFAULT_RANK,  gst_omx_g711enc_get_type },
+    { "omx_g729dec",       "OMX.st.audio_decoder.g729",       DEFAULT_RANK,  gst_omx_g729dec_get_type },
+    { "omx_g729enc",       "OMX.st.audio_encoder.g729",       DEFAULT_RANK,  gst_omx_g729enc_get_type },
+    { "omx_ilbcdec",       "OMX.st.audio_decoder.ilbc",       DEFAULT_RANK,  gst_omx_ilbcdec_get_type },
+    { "omx_ilbcenc",       "OMX.st.audio_encoder.ilbc",       DEFAULT_RANK,  gst_omx_ilbcenc_get_type },
+    { "omx_audiosink",     "OMX.st.alsa.alsasink",            GST_RANK_NONE, gst_omx_audiosink_get_type },
+    { "omx_videosink",     "OMX.st.videosink",                GST_RANK_NONE, gst_omx_videosink_get_type },
+    { "omx_filereadersrc", "OMX.st.audio_filereader",         GST_RANK_NONE, gst_omx_filereadersrc_get_type },
+};
+
+/** For the properties that choose a GOmxAllocation. */
+GType
+gst_omx_allocation_get_type (void)
+{
+    static GType type = 0;
 
-    if (!gst_element_register (plugin, "omx_dummy", GST_RANK_NONE, GST_OMX_DUMMY_TYPE))
+    if (G_UNLIKELY (type == 0))
     {
-        return false;
+        static const GEnumValue values[] =
+        {
+            { GOMX_ALLOCATION_USE, "We allocate the buffers", "use" },
+            { GOMX_ALLOCATION_ALLOCATE, "The component allocates the buffers", "allocate" },
+            { GOMX_ALLOCATION_AUTO, "The component allocates the buffers if it can", "auto" },
+            { 0, NULL, NULL }
+        };
+
+        type = g_enum_register_static ("GstOmxAllocation", values);
     }
 
-    if (!gst_element_register (plugin, "omx_mpeg4dec", DEFAULT_RANK, GST_OMX_MPEG4DEC_TYPE))
-    {
-        return false;
-    }
+    return type;
+}
 
-    if (!gst_element_register (plugin, "omx_h263dec", DEFAULT_RANK, GST_OMX_H263DEC_TYPE))
-    {
-        return false;
-    }
+static const Builtin *
+find_builtin (const gchar *name)
+{
+    guint i;
 
-    if (!gst_element_register (plugin, "omx_h264dec", DEFAULT_RANK, GST_OMX_H264DEC_TYPE))
+    for (i = 0; i < G_N_ELEMENTS (builtins); i++)
     {
-        return false;
+        if (strcmp (builtins[i].name, name) == 0)
+            return &builtins[i];
     }
 
-    if (!gst_element_register (plugin, "omx_wmvdec", DEFAULT_RANK, GST_OMX_WMVDEC_TYPE))
-    {
-        return false;
-    }
+    return NULL;
+}
 
-    if (!gst_element_register (plugin, "omx_mpeg4enc", DEFAULT_RANK, GST_OMX_MPEG4ENC_TYPE))
-    {
-        return false;
-    }
+static GKeyFile *
+load_config (void)
+{
+    GKeyFile *config;
+    const gchar *file;
+    const gchar * const *dirs;
+    gchar *path;
 
-    if (!gst_element_register (plugin, "omx_avcenc", DEFAULT_RANK, GST_OMX_AVCENC_TYPE))
-    {
-        return false;
-    }
+    config = g_key_file_new ();
 
-    if (!gst_element_register (plugin, "omx_h263enc", DEFAULT_RANK, GST_OMX_H263ENC_TYPE))
+    file = g_getenv ("GST_OMX_CONFIG");
+    if (file)
     {
-        return false;
+        if (g_key_file_load_from_file (config, file, G_KEY_FILE_NONE, NULL))
+            return config;
+        GST_WARNING ("couldn't load %s", file);
+        g_key_file_free (config);
+        return NULL;
     }
 
-    if (!gst_element_register (plugin, "omx_vorbisdec", DEFAULT_RANK, GST_OMX_VORBISDEC_TYPE))
+    path = g_build_filename (g_get_user_config_dir (), "gstomx.conf", NULL);
+    if (g_key_file_load_from_file (config, path, G_KEY_FILE_NONE, NULL))
     {
-        return false;
+        g_free (path);
+        return config;
     }
+    g_free (path);
 
-    if (!gst_element_register (plugin, "omx_mp3dec", DEFAULT_RANK, GST_OMX_MP3DEC_TYPE))
+    for (dirs = g_get_system_config_dirs (); *dirs; dirs++)
     {
-        return false;
+        path = g_build_filename (*dirs, "gstomx.conf", NULL);
+        if (g_key_file_load_from_file (config, path, G_KEY_FILE_NONE, NULL))
+        {
+            g_free (path);
+            return config;
+        }
+        g_free (path);
     }
 
-    if (!gst_element_register (plugin, "omx_amrnbdec", DEFAULT_RANK, GST_OMX_AMRNBDEC_TYPE))
-    {
-        return false;
-    }
+    g_key_file_free (config);
 
-    if (!gst_element_register (plugin, "omx_amrnbenc", DEFAULT_RANK, GST_OMX_AMRNBENC_TYPE))
-    {
-        return false;
-    }
+    return NULL;
+}
 
-    if (!gst_element_register (plugin, "omx_amrwbdec", DEFAULT_RANK, GST_OMX_AMRWBDEC_TYPE))
+/**
+ * The elements come from the configuration file and the environment;
+ * GStreamer only looks at them again if it knows.
+ */
+static void
+add_config_dependencies (GstPlugin *plugin)
+{
+    const gchar *env_vars[] = { "GST_OMX_CONFIG", "GST_OMX_LIBRARIES", NULL };
+    const gchar *names[] = { "gstomx.conf", NULL };
+    const gchar * const *system_dirs;
+    const gchar **paths;
+    const gchar *file;
+    guint n;
+    guint i;
+
+    gst_plugin_add_dependency (plugin, env_vars, NULL, NULL, GST_PLUGIN_DEPENDENCY_FLAG_NONE);
+
+    file = g_getenv ("GST_OMX_CONFIG");
+    if (file)
     {
-        return false;
+        const gchar *file_paths[2] = { NULL, NULL };
+        const gchar *file_names[2] = { NULL, NULL };
+        gchar *dir;
+        gchar *base;
+
+        dir = g_path_get_dirname (file);
+        base = g_path_get_basename (file);
+        file_paths[0] = dir;
+        file_names[0] = base;
+
+        gst_plugin_add_dependency (plugin, NULL, file_paths, file_names, GST_PLUGIN_DEPENDENCY_FLAG_NONE);
+
+        g_free (base);
+        g_free (dir);
+        return;
     }
 
-    if (!gst_element_register (plugin, "omx_amrwbenc", DEFAULT_RANK, GST_OMX_AMRWBENC_TYPE))
+    system_dirs = g_get_system_config_dirs ();
+    paths = g_new0 (const gchar *, g_strv_length ((gchar **) system_dirs) + 2);
+    n = 0;
+
+    paths[n++] = g_get_user_config_dir ();
+    for (i = 0; system_dirs[i]; i++)
+        paths[n++] = system_dirs[i];
+
+    gst_plugin_add_dependency (plugin, NULL, paths, names, GST_PLUGIN_DEPENDENCY_FLAG_NONE);
+
+    g_free (paths);
+}
+
+/**
+ * A group in the configuration file. It is made of the built-in element
+ * named by its type, or of the one with the same name; whatever it doesn't
+ * say comes from there.
+ */
+static Descriptor *
+descriptor_from_config (GKeyFile *config,
+                        const gchar *group)
+{
+    Descriptor *descriptor;
+    const Builtin *builtin;
+    gchar *type;
+
+    type = g_key_file_get_string (config, group, "type", NULL);
+    if (type)
     {
-        return false;
+        builtin = find_builtin (type);
+        if (!builtin)
+            GST_WARNING ("%s: unknown type %s", group, type);
+        g_free (type);
     }
-
-    if (!gst_element_register (plugin, "omx_aacdec", DEFAULT_RANK, GST_OMX_AACDEC_TYPE))
+    else
     {
-        return false;
+        builtin = find_builtin (group);
+        if (!builtin)
+            GST_WARNING ("%s: no type", group);
     }
 
-    if (!gst_element_register (plugin, "omx_aacenc", DEFAULT_RANK, GST_OMX_AACENC_TYPE))
+    if (!builtin)
+        return NULL;
+
+    descriptor = g_new0 (Descriptor, 1);
+    descriptor->name = g_strdup (group);
+    descriptor->type = builtin;
+
+    descriptor->library = g_key_file_get_string (config, group, "library", NULL);
+    if (!descriptor->library)
+        descriptor->library = DEFAULT_LIBRARY_NAME;
+
+    descriptor->component = g_key_file_get_string (config, group, "component", NULL);
+    if (!descriptor->component)
+        descriptor->component = builtin->component;
+
+    descriptor->role = g_key_file_get_string (config, group, "role", NULL);
+
+    if (g_key_file_has_key (config, group, "rank", NULL))
+        descriptor->rank = g_key_file_get_integer (config, group, "rank", NULL);
+    else
+        descriptor->rank = builtin->rank;
+
+    descriptor->sink_caps = g_key_file_get_string (config, group, "sink-caps", NULL);
+    descriptor->src_caps = g_key_file_get_string (config, group, "src-caps", NULL);
+
+    return descriptor;
+}
+
+/**
+ * The elements to register: the ones in the configuration file if there
+ * is one, the built-in ones otherwise. They are never freed; the types
+ * registered from them refer to them.
+ */
+static GSList *
+get_descriptors (void)
+{
+    GSList *descriptors = NULL;
+    GKeyFile *config;
+
+    config = load_config ();
+
+    if (config)
     {
-        return false;
-    }
+        gchar **groups;
+        guint i;
 
-    if (!gst_element_register (plugin, "omx_adpcmdec", DEFAULT_RANK, GST_OMX_ADPCMDEC_TYPE))
+        groups = g_key_file_get_groups (config, NULL);
+
+        for (i = 0; groups[i]; i++)
+        {
+            Descriptor *descriptor;
+
+            descriptor = descriptor_from_config (config, groups[i]);
+            if (descriptor)
+                descriptors = g_slist_prepend (descriptors, descriptor);
+        }
+
+        g_strfreev (groups);
+        g_key_file_free (config);
+    }
+    else
     {
-        return false;
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (builtins); i++)
+        {
+            Descriptor *descriptor;
+
+            descriptor = g_new0 (Descriptor, 1);
+            descriptor->name = builtins[i].name;
+            descriptor->type = &builtins[i];
+            descriptor->library = DEFAULT_LIBRARY_NAME;
+            descriptor->component = builtins[i].component;
+            descriptor->rank = builtins[i].rank;
+
+            descriptors = g_slist_prepend (descriptors, descriptor);
+        }
     }
 
-    if (!gst_element_register (plugin, "omx_adpcmenc", DEFAULT_RANK, GST_OMX_ADPCMENC_TYPE))
+    return g_slist_reverse (descriptors);
+}
+
+static void
+registry_free (gpointer data)
+{
+    if (data)
+        g_omx_registry_free (data);
+}
+
+/**
+ * GStreamer keeps the features of a plugin until the plugin changes; what
+ * the libraries provide has to be declared for it to look again.
+ */
+static void
+add_registry_dependencies (gpointer key,
+                           gpointer value,
+                           gpointer user_data)
+{
+    GstPlugin *plugin;
+    GOmxRegistry *registry;
+    gchar **files;
+    guint i;
+
+    plugin = user_data;
+    registry = value;
+
+    if (!registry)
+        return;
+
+    files = g_omx_registry_get_files (registry);
+
+    for (i = 0; files[i]; i++)
     {
-        return false;
+        const gchar *paths[2] = { NULL, NULL };
+        const gchar *names[2] = { NULL, NULL };
+        gchar *dir;
+        gchar *base;
+
+        dir = g_path_get_dirname (files[i]);
+        base = g_path_get_basename (files[i]);
+        paths[0] = dir;
+        names[0] = base;
+
+        gst_plugin_add_dependency (plugin, NULL, paths, names, GST_PLUGIN_DEPENDENCY_FLAG_NONE);
+
+        g_free (base);
+        g_free (dir);
     }
 
-    if (!gst_element_register (plugin, "omx_g711dec", DEFAULT_RANK, GST_OMX_G711DEC_TYPE))
+    g_strfreev (files);
+}
+
+/**
+ * Whether the component is in one of its libraries. Without a registry we
+ * can't tell, so it might be. Elements that are never autoplugged are
+ * usually pointed at some other library by hand; the configured one has no
+ * say.
+ */
+static gboolean
+component_exists (GHashTable *registries,
+                  const Descriptor *descriptor)
+{
+    gchar **libraries;
+    gboolean ret = false;
+    guint i;
+
+    if (descriptor->rank == GST_RANK_NONE)
+        return true;
+
+    libraries = g_omx_expand_libraries (descriptor->library);
+
+    for (i = 0; libraries[i] && !ret; i++)
     {
-        return false;
+        GOmxRegistry *registry;
+        gpointer value;
+
+        if (!g_hash_table_lookup_extended (registries, libraries[i], NULL, &value))
+        {
+            value = g_omx_registry_load (libraries[i]);
+            g_hash_table_insert (registries, g_strdup (libraries[i]), value);
+        }
+
+        registry = value;
+
+        ret = !registry || g_omx_registry_has_component (registry, descriptor->component);
     }
 
-    if (!gst_element_register (plugin, "omx_g711enc", DEFAULT_RANK, GST_OMX_G711ENC_TYPE))
+    g_strfreev (libraries);
+
+    return ret;
+}
+
+static void
+replace_pad_template (GstElementClass *element_class,
+                      const gchar *name,
+                      GstPadDirection direction,
+                      const gchar *caps_string)
+{
+    GstPadTemplate *template;
+    GstCaps *caps;
+
+    caps = gst_caps_from_string (caps_string);
+    if (!caps)
     {
-        return false;
+        GST_WARNING ("invalid caps: %s", caps_string);
+        return;
     }
 
-    if (!gst_element_register (plugin, "omx_g729dec", DEFAULT_RANK, GST_OMX_G729DEC_TYPE))
+    /* Older cores would keep both if we just added the new one. */
+    template = gst_element_class_get_pad_template (element_class, name);
+    if (template)
     {
-        return false;
+        element_class->padtemplates = g_list_remove (element_class->padtemplates, template);
+        element_class->numpadtemplates--;
+        gst_object_unref (template);
     }
 
-    if (!gst_element_register (plugin, "omx_g729enc", DEFAULT_RANK, GST_OMX_G729ENC_TYPE))
+    template = gst_pad_template_new (name, direction, GST_PAD_ALWAYS, caps);
+    gst_element_class_add_pad_template (element_class, template);
+}
+
+static void
+descriptor_base_init (gpointer g_class)
+{
+    GstElementClass *element_class;
+    const Descriptor *descriptor;
+
+    element_class = GST_ELEMENT_CLASS (g_class);
+    descriptor = g_type_get_qdata (G_TYPE_FROM_CLASS (g_class), descriptor_quark);
+
+    if (descriptor->sink_caps)
+        replace_pad_template (element_class, "sink", GST_PAD_SINK, descriptor->sink_caps);
+
+    if (descriptor->src_caps)
+        replace_pad_template (element_class, "src", GST_PAD_SRC, descriptor->src_caps);
+}
+
+static void
+descriptor_instance_init (GTypeInstance *instance,
+                          gpointer g_class)
+{
+    const Descriptor *descriptor;
+
+    descriptor = g_type_get_qdata (G_TYPE_FROM_CLASS (g_class), descriptor_quark);
+
+    g_object_set (instance,
+                  "library-name", descriptor->library,
+                  "component-name", descriptor->component,
+                  "component-role", descriptor->role,
+                  NULL);
+}
+
+/**
+ * Each element gets a type of its own, derived from the built-in one, so
+ * the same code can be registered under different names, with different
+ * components.
+ */
+static gboolean
+register_element (GstPlugin *plugin,
+                  Descriptor *descriptor)
+{
+    GType parent;
+    GType type;
+    gchar *type_name;
+
+    parent = descriptor->type->get_type ();
+
+    type_name = g_strdup_printf ("GstOmx_%s", descriptor->name);
+    type = g_type_from_name (type_name);
+
+    if (!type)
     {
-        return false;
+        GTypeInfo *type_info;
+        GTypeQuery query;
+
+        g_type_query (parent, &query);
+
+        type_info = g_new0 (GTypeInfo, 1);
+        type_info->class_size = query.class_size;
+        type_info->base_init = descriptor_base_init;
+        type_info->instance_size = query.instance_size;
+        type_info->instance_init = descriptor_instance_init;
+
+        type = g_type_register_static (parent, type_name, type_info, 0);
+        g_type_set_qdata (type, descriptor_quark, descriptor);
+
+        g_free (type_info);
     }
 
-    if (!gst_element_register (plugin, "omx_ilbcdec", DEFAULT_RANK, GST_OMX_ILBCDEC_TYPE))
+    g_free (type_name);
+
+    return gst_element_register (plugin, descriptor->name, descriptor->rank, type);
+}
+
+static gboolean
+plugin_init (GstPlugin *plugin)
+{
+    GST_DEBUG_CATEGORY_INIT (gstomx_debug, "omx", 0, "OpenMAX");
+
+    g_omx_init ();
+
+    /* GST_OMX_LIBRARIES=library[:library...]; what library-name=auto tries. */
     {
-        return false;
+        const gchar *libraries;
+        gchar **names;
+        libraries = g_getenv ("GST_OMX_LIBRARIES");
+        names = g_strsplit (libraries ? libraries : DEFAULT_LIBRARY_NAME, ":", 0);
+        g_omx_set_libraries ((const gchar *const *) names);
+        g_strfreev (names);
     }
 
-    if (!gst_element_register (plugin, "omx_ilbcenc", DEFAULT_RANK, GST_OMX_ILBCENC_TYPE))
+    /* GST_OMX_HANDLE_POOL=max[:idle seconds] */
     {
-        return false;
+        const gchar *pool;
+        pool = g_getenv ("GST_OMX_HANDLE_POOL");
+        if (pool)
+        {
+            guint max = 0;
+            guint idle = 0;
+            sscanf (pool, "%u:%u", &max, &idle);
+            g_omx_set_handle_pool (max, idle);
+        }
     }
 
-    if (!gst_element_register (plugin, "omx_audiosink", GST_RANK_NONE, GST_OMX_AUDIOSINK_TYPE))
+    /* GST_OMX_LINGER=seconds */
     {
-        return false;
+        const gchar *linger;
+        linger = g_getenv ("GST_OMX_LINGER");
+        if (linger)
+            g_omx_set_linger (strtoul (linger, NULL, 10));
     }
 
-    if (!gst_element_register (plugin, "omx_videosink", GST_RANK_NONE, GST_OMX_VIDEOSINK_TYPE))
+    /* GST_OMX_PRELOAD=library[:library...]; empty for the default one. */
     {
-        return false;
+        const gchar *preload;
+        preload = g_getenv ("GST_OMX_PRELOAD");
+        if (preload)
+        {
+            gchar **names;
+            if (*preload)
+                names = g_strsplit (preload, ":", 0);
+            else
+                names = g_strsplit (DEFAULT_LIBRARY_NAME, ":", 0);
+            g_omx_preload ((const gchar *const *) names);
+            g_strfreev (names);
+        }
     }
 
-    if (!gst_element_register (plugin, "omx_filereadersrc", GST_RANK_NONE, GST_OMX_FILEREADERSRC_TYPE))
+    descriptor_quark = g_quark_from_static_string ("gstomx-descriptor");
+
+    add_config_dependencies (plugin);
+
     {
-        return false;
+        GSList *descriptors;
+        GSList *l;
+        GHashTable *registries;
+        gboolean ret = true;
+
+        descriptors = get_descriptors ();
+        registries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, registry_free);
+
+        for (l = descriptors; l; l = l->next)
+        {
+            Descriptor *descriptor;
+
+            descriptor = l->data;
+
+            if (!component_exists (registries, descriptor))
+            {
+                GST_INFO ("%s not found, skipping %s", descriptor->component, descriptor->name);
+                continue;
+            }
+
+            if (!register_element (plugin, descriptor))
+            {
+                ret = false;
+                break;
+            }
+        }
+
+        /* Where the libraries and their registration files are found. */
+        {
+            const gchar *env_vars[] = { "LD_LIBRARY_PATH", "OMX_BELLAGIO_REGISTRY", NULL };
+            gst_plugin_add_dependency (plugin, env_vars, NULL, NULL, GST_PLUGIN_DEPENDENCY_FLAG_NONE);
+        }
+        g_hash_table_foreach (registries, add_registry_dependencies, plugin);
+
+        g_hash_table_destroy (registries);
+        g_slist_free (descriptors);
+
+        if (!ret)
+            return false;
     }
 
     return true;
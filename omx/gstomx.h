@@ -31,6 +31,9 @@ G_BEGIN_DECLS
 GST_DEBUG_CATEGORY_EXTERN (gstomx_debug);
 #define GST_CAT_DEFAULT gstomx_debug
 
+#define GST_OMX_TYPE_ALLOCATION (gst_omx_allocation_get_type ())
+GType gst_omx_allocation_get_type (void);
+
 G_END_DECLS
 
 #endif /* GSTOMX_H */
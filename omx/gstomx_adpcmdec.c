@@ -23,8 +23,6 @@
 #include "gstomx_base_filter.h"
 #include "gstomx.h"
 
-#define OMX_COMPONENT_NAME "OMX.st.audio_decoder.adpcm"
-
 static GstOmxBaseFilterClass *parent_class = NULL;
 
 static GstCaps *
@@ -171,8 +169,6 @@ type_instance_init (GTypeInstance *instance,
 
     omx_base = GST_OMX_BASE_FILTER (instance);
 
-    omx_base->omx_component = g_strdup (OMX_COMPONENT_NAME);
-
     omx_base->gomx->settings_changed_cb = settings_changed_cb;
 
     gst_pad_set_setcaps_function (omx_base->sinkpad, sink_setcaps);
@@ -22,8 +22,6 @@
 #include "gstomx_audiosink.h"
 #include "gstomx.h"
 
-#define OMX_COMPONENT_NAME "OMX.st.alsa.alsasink"
-
 static GstOmxBaseSinkClass *parent_class = NULL;
 
 static GstCaps *
@@ -153,8 +151,6 @@ type_instance_init (GTypeInstance *instance,
     omx_base = GST_OMX_BASE_SINK (instance);
 
     GST_DEBUG_OBJECT (omx_base, "start");
-
-    omx_base->omx_component = g_strdup (OMX_COMPONENT_NAME);
 }
 
 GType
@@ -21,22 +21,326 @@
 
 #include "gstomx_base_filter.h"
 #include "gstomx.h"
+#include "gstomx_stats.h"
+#include "gstomx_buffer.h"
 
 #include <string.h> /* For memcpy */
 
-static gboolean share_input_buffer = FALSE;
-static gboolean share_output_buffer = FALSE;
-
 enum
 {
     ARG_0,
     ARG_COMPONENT_NAME,
     ARG_LIBRARY_NAME,
-    ARG_USE_TIMESTAMPS
+    ARG_COMPONENT_ROLE,
+    ARG_USE_TIMESTAMPS,
+    ARG_STALL_TIMEOUT,
+    ARG_STALL_RESET,
+    ARG_SHARED_OUTPUT,
+    ARG_OUTPUT_LOW_WATERMARK,
+    ARG_OUTPUT_HIGH_WATERMARK,
+    ARG_SPIN_COUNT,
+    ARG_PREFAULT_BUFFERS,
+    ARG_INPUT_ALLOCATION,
+    ARG_OUTPUT_ALLOCATION,
+    ARG_INPUT_BUFFERS,
+    ARG_OUTPUT_BUFFERS,
+    ARG_ZERO_COPY_INPUT,
+    ARG_AGGREGATE_BYTES,
+    ARG_AGGREGATE_TIME,
+    ARG_INPUT_QUEUE_BUFFERS,
+    ARG_INPUT_QUEUE_BYTES,
+    ARG_INPUT_QUEUE_TIME,
+    ARG_DIRECT_PUSH,
+    ARG_LOW_LATENCY,
+    ARG_STATS
 };
 
 static GstElementClass *parent_class = NULL;
 
+/* Runs with the output queue unlocked; see g_omx_port_set_watermarks(). */
+static void
+output_watermark_cb (GOmxPort *port)
+{
+    GstOmxBaseFilter *self;
+    GstStructure *structure;
+
+    self = port->core->client_data;
+
+    GST_DEBUG_OBJECT (self, "output %s watermark",
+                      port->above_watermark ? "above high" : "down to low");
+
+    g_mutex_lock (self->backpressure_mutex);
+    self->backpressure = port->above_watermark;
+    g_cond_broadcast (self->backpressure_cond);
+    g_mutex_unlock (self->backpressure_mutex);
+
+    structure = gst_structure_new ("omx-watermark",
+                                   "port", G_TYPE_STRING, "output",
+                                   "high", G_TYPE_BOOLEAN, port->above_watermark,
+                                   "queued", G_TYPE_UINT, async_queue_length (port->queue),
+                                   "capacity", G_TYPE_UINT, port->num_buffers,
+                                   NULL);
+
+    gst_element_post_message (GST_ELEMENT (self),
+                              gst_message_new_element (GST_OBJECT (self), structure));
+}
+
+/* Holds the input back while the output is above its high watermark. */
+static void
+wait_for_output (GstOmxBaseFilter *self)
+{
+    g_mutex_lock (self->backpressure_mutex);
+    while (self->backpressure && !self->flushing)
+    {
+        GST_LOG_OBJECT (self, "waiting for output to drain");
+        g_cond_wait (self->backpressure_cond, self->backpressure_mutex);
+    }
+    g_mutex_unlock (self->backpressure_mutex);
+}
+
+static void
+set_flushing (GstOmxBaseFilter *self,
+              gboolean flushing)
+{
+    g_mutex_lock (self->backpressure_mutex);
+    self->flushing = flushing;
+    g_cond_broadcast (self->backpressure_cond);
+    g_mutex_unlock (self->backpressure_mutex);
+}
+
+/** Takes the EOS event waiting for the component to drain, if any. */
+static GstEvent *
+take_eos (GstOmxBaseFilter *self)
+{
+    GstEvent *event;
+
+    GST_OBJECT_LOCK (self);
+    event = self->eos_event;
+    self->eos_event = NULL;
+    GST_OBJECT_UNLOCK (self);
+
+    return event;
+}
+
+static void
+drop_eos (GstOmxBaseFilter *self)
+{
+    GstEvent *event;
+
+    event = take_eos (self);
+    if (event)
+        gst_event_unref (event);
+}
+
+static void
+qos_reset (GstOmxBaseFilter *self)
+{
+    gst_segment_init (&self->segment, GST_FORMAT_TIME);
+    self->qos_resync = FALSE;
+
+    GST_OBJECT_LOCK (self);
+    self->earliest_time = GST_CLOCK_TIME_NONE;
+    GST_OBJECT_UNLOCK (self);
+}
+
+/* Drops whatever is queued; in_mutex held. */
+static void
+input_queue_clear (GstOmxBaseFilter *self)
+{
+    GstBuffer *buf;
+
+    while ((buf = g_queue_pop_head (self->in_queue)))
+        gst_buffer_unref (buf);
+
+    self->in_queued_bytes = 0;
+    g_cond_broadcast (self->in_cond);
+}
+
+/**
+ * Drops the queued input; with flushing, it's refused until this is called
+ * again without. Returns once the input thread isn't submitting anything.
+ */
+static void
+flush_input (GstOmxBaseFilter *self,
+             gboolean flushing)
+{
+    g_mutex_lock (self->in_mutex);
+    self->in_flushing = flushing;
+    self->in_return = GST_FLOW_OK;
+    input_queue_clear (self);
+    if (!flushing)
+    {
+        while (self->in_busy)
+            g_cond_wait (self->in_cond, self->in_mutex);
+    }
+    g_mutex_unlock (self->in_mutex);
+}
+
+/**
+ * Stops the input thread, dropping what's queued; input is refused until
+ * flush_input() lets it in again.
+ */
+static void
+stop_input (GstOmxBaseFilter *self)
+{
+    GThread *thread;
+
+    g_mutex_lock (self->in_mutex);
+    thread = self->in_thread;
+    self->in_thread = NULL;
+    self->in_quit = TRUE;
+    self->in_flushing = TRUE;
+    input_queue_clear (self);
+    g_mutex_unlock (self->in_mutex);
+
+    if (thread)
+        g_thread_join (thread);
+
+    g_mutex_lock (self->in_mutex);
+    self->in_quit = FALSE;
+    g_mutex_unlock (self->in_mutex);
+}
+
+/** Latency has to grow this much before the pipeline is told again. */
+#define LATENCY_SLACK GST_MSECOND
+
+static void
+latency_reset (GstOmxBaseFilter *self)
+{
+    guint i;
+
+    g_mutex_lock (self->latency_mutex);
+    for (i = 0; i < GST_OMX_BASE_FILTER_LATENCY_SAMPLES; i++)
+        self->latency_times[i] = GST_CLOCK_TIME_NONE;
+    for (i = 0; i < GST_OMX_BASE_FILTER_LATENCY_WINDOW; i++)
+        self->latency_delays[i] = 0;
+    self->latency_next = 0;
+    self->latency_delay_next = 0;
+    self->latency = 0;
+    self->reported_latency = 0;
+    g_mutex_unlock (self->latency_mutex);
+}
+
+/**
+ * Notes when the input with this timestamp went to the component, right
+ * before EmptyThisBuffer; the output that comes back with it tells how long
+ * the component took. Only the latest few are remembered.
+ */
+static void
+latency_in (GstOmxBaseFilter *self,
+            OMX_TICKS timestamp)
+{
+    GTimeVal now;
+
+    g_get_current_time (&now);
+
+    g_mutex_lock (self->latency_mutex);
+    self->latency_timestamps[self->latency_next] = timestamp;
+    self->latency_times[self->latency_next] = GST_TIMEVAL_TO_TIME (now);
+    self->latency_next = (self->latency_next + 1) % GST_OMX_BASE_FILTER_LATENCY_SAMPLES;
+    g_mutex_unlock (self->latency_mutex);
+}
+
+/**
+ * Counterpart of latency_in, from FillBufferDone, so time spent waiting on
+ * our side doesn't count. The latency is the longest of the latest delays,
+ * so a hiccup is forgotten after a while; the pipeline is told whenever it
+ * grows beyond, or falls well below, what it was last told.
+ */
+static void
+latency_out (GstOmxBaseFilter *self,
+             OMX_TICKS timestamp)
+{
+    GTimeVal now;
+    GstClockTime time;
+    GstClockTime latency = GST_CLOCK_TIME_NONE;
+    guint i;
+
+    g_get_current_time (&now);
+    time = GST_TIMEVAL_TO_TIME (now);
+
+    g_mutex_lock (self->latency_mutex);
+    for (i = 0; i < GST_OMX_BASE_FILTER_LATENCY_SAMPLES; i++)
+    {
+        GstClockTime delay;
+        guint j;
+
+        if (self->latency_timestamps[i] != timestamp ||
+            !GST_CLOCK_TIME_IS_VALID (self->latency_times[i]))
+            continue;
+
+        delay = time > self->latency_times[i] ? time - self->latency_times[i] : 0;
+        self->latency_times[i] = GST_CLOCK_TIME_NONE;
+
+        self->latency_delays[self->latency_delay_next] = delay;
+        self->latency_delay_next = (self->latency_delay_next + 1) % GST_OMX_BASE_FILTER_LATENCY_WINDOW;
+
+        self->latency = 0;
+        for (j = 0; j < GST_OMX_BASE_FILTER_LATENCY_WINDOW; j++)
+            self->latency = MAX (self->latency, self->latency_delays[j]);
+
+        if (self->latency > self->reported_latency + LATENCY_SLACK ||
+            self->latency < self->reported_latency / 2)
+        {
+            self->reported_latency = self->latency;
+            latency = self->latency;
+        }
+        break;
+    }
+    g_mutex_unlock (self->latency_mutex);
+
+    if (G_UNLIKELY (GST_CLOCK_TIME_IS_VALID (latency)))
+    {
+        GST_INFO_OBJECT (self, "latency: %" GST_TIME_FORMAT, GST_TIME_ARGS (latency));
+        gst_element_post_message (GST_ELEMENT (self),
+                                  gst_message_new_latency (GST_OBJECT (self)));
+    }
+}
+
+/** Called from FillBufferDone in low-latency mode. */
+static void
+output_done (GOmxPort *port,
+             OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    GstOmxBaseFilter *self;
+
+    self = port->core->client_data;
+
+    if (omx_buffer->nFilledLen > 0)
+        latency_out (self, omx_buffer->nTimeStamp);
+}
+
+static GOmxPort *
+setup_port (GstOmxBaseFilter *self,
+            OMX_PARAM_PORTDEFINITIONTYPE *param,
+            GOmxBufferCount *count,
+            const gchar *name)
+{
+    GOmxPort *port;
+    guint old_count;
+    gboolean grow;
+
+    old_count = count->count;
+    grow = count->grow;
+
+    /* The fewest buffers the component takes, unless told otherwise. */
+    if (self->low_latency && count->wanted == 0 &&
+        param->nBufferCountActual != MAX (param->nBufferCountMin, 1))
+    {
+        param->nBufferCountActual = MAX (param->nBufferCountMin, 1);
+        OMX_SetParameter (self->gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+    }
+
+    port = g_omx_core_setup_port_count (self->gomx, param, count);
+
+    if (grow)
+        GST_INFO_OBJECT (self, "%s port starved, buffers: %u -> %u", name, old_count, port->num_buffers);
+    else
+        GST_DEBUG_OBJECT (self, "%s buffers: %u", name, port->num_buffers);
+
+    return port;
+}
+
 static void
 setup_ports (GstOmxBaseFilter *self)
 {
@@ -54,15 +358,31 @@ setup_ports (GstOmxBaseFilter *self)
 
     param->nPortIndex = 0;
     OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
-    self->in_port = g_omx_core_setup_port (core, param);
+    self->in_port = setup_port (self, param, &self->in_count, "input");
+    self->in_port->allocation = self->in_allocation;
 
     /* Output port configuration. */
 
     param->nPortIndex = 1;
     OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
-    self->out_port = g_omx_core_setup_port (core, param);
+    self->out_port = setup_port (self, param, &self->out_count, "output");
+    self->out_port->allocation = self->out_allocation;
 
     free (param);
+
+    g_free (self->out_batch);
+    self->out_batch = g_new (OMX_BUFFERHEADERTYPE *, self->out_port->num_buffers);
+
+    self->pending = NULL;
+
+    g_mutex_lock (self->backpressure_mutex);
+    self->backpressure = FALSE;
+    g_mutex_unlock (self->backpressure_mutex);
+
+    self->out_port->watermark_cb = output_watermark_cb;
+    g_omx_port_set_watermarks (self->out_port,
+                               self->out_low_watermark,
+                               MIN (self->out_high_watermark, self->out_port->num_buffers));
 }
 
 static GstStateChangeReturn
@@ -83,9 +403,17 @@ change_state (GstElement *element,
     switch (transition)
     {
         case GST_STATE_CHANGE_NULL_TO_READY:
-            g_omx_core_init (self->gomx, self->omx_library, self->omx_component);
+            g_omx_core_init_role (self->gomx, self->omx_library, self->omx_component, self->omx_role);
             if (self->gomx->omx_error)
                 return GST_STATE_CHANGE_FAILURE;
+
+            GST_INFO_OBJECT (self, "using %s", g_omx_core_get_library_name (self->gomx));
+            break;
+
+        case GST_STATE_CHANGE_READY_TO_PAUSED:
+            flush_input (self, FALSE);
+            latency_reset (self);
+            qos_reset (self);
             break;
 
         case GST_STATE_CHANGE_PAUSED_TO_READY:
@@ -94,6 +422,10 @@ change_state (GstElement *element,
                 g_omx_port_finish (self->in_port);
                 g_omx_port_finish (self->out_port);
             }
+            /* The input thread may be held back by the output. */
+            set_flushing (self, TRUE);
+            stop_input (self);
+            drop_eos (self);
             break;
 
         default:
@@ -141,8 +473,22 @@ dispose (GObject *obj)
 
     g_omx_core_free (self->gomx);
 
+    g_free (self->out_batch);
+
+    g_cond_free (self->backpressure_cond);
+    g_mutex_free (self->backpressure_mutex);
+
+    g_queue_free (self->in_queue);
+    g_cond_free (self->in_cond);
+    g_mutex_free (self->in_mutex);
+
+    g_mutex_free (self->latency_mutex);
+
+    drop_eos (self);
+
     g_free (self->omx_component);
     g_free (self->omx_library);
+    g_free (self->omx_role);
 
     G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
@@ -173,9 +519,70 @@ set_property (GObject *obj,
             }
             self->omx_library = g_value_dup_string (value);
             break;
+        case ARG_COMPONENT_ROLE:
+            g_free (self->omx_role);
+            self->omx_role = g_value_dup_string (value);
+            break;
         case ARG_USE_TIMESTAMPS:
             self->use_timestamps = g_value_get_boolean (value);
             break;
+        case ARG_STALL_TIMEOUT:
+            self->gomx->timeout = g_value_get_uint (value) * 1000;
+            break;
+        case ARG_STALL_RESET:
+            self->gomx->reset_on_stall = g_value_get_boolean (value);
+            break;
+        case ARG_SHARED_OUTPUT:
+            self->shared_output = g_value_get_boolean (value);
+            break;
+        case ARG_OUTPUT_LOW_WATERMARK:
+            self->out_low_watermark = g_value_get_uint (value);
+            break;
+        case ARG_OUTPUT_HIGH_WATERMARK:
+            self->out_high_watermark = g_value_get_uint (value);
+            break;
+        case ARG_SPIN_COUNT:
+            g_omx_core_set_spin (self->gomx, g_value_get_uint (value));
+            break;
+        case ARG_INPUT_BUFFERS:
+            self->in_count.wanted = g_value_get_int (value);
+            break;
+        case ARG_OUTPUT_BUFFERS:
+            self->out_count.wanted = g_value_get_int (value);
+            break;
+        case ARG_INPUT_ALLOCATION:
+            self->in_allocation = g_value_get_enum (value);
+            break;
+        case ARG_OUTPUT_ALLOCATION:
+            self->out_allocation = g_value_get_enum (value);
+            break;
+        case ARG_PREFAULT_BUFFERS:
+            self->gomx->prefault = g_value_get_boolean (value);
+            break;
+        case ARG_ZERO_COPY_INPUT:
+            self->zero_copy_input = g_value_get_boolean (value);
+            break;
+        case ARG_AGGREGATE_BYTES:
+            self->aggregate_bytes = g_value_get_uint (value);
+            break;
+        case ARG_AGGREGATE_TIME:
+            self->aggregate_time = g_value_get_uint64 (value);
+            break;
+        case ARG_INPUT_QUEUE_BUFFERS:
+            self->in_queue_buffers = g_value_get_uint (value);
+            break;
+        case ARG_INPUT_QUEUE_BYTES:
+            self->in_queue_bytes = g_value_get_uint (value);
+            break;
+        case ARG_INPUT_QUEUE_TIME:
+            self->in_queue_time = g_value_get_uint64 (value);
+            break;
+        case ARG_DIRECT_PUSH:
+            self->direct_push = g_value_get_boolean (value);
+            break;
+        case ARG_LOW_LATENCY:
+            self->low_latency = g_value_get_boolean (value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -200,9 +607,81 @@ get_property (GObject *obj,
         case ARG_LIBRARY_NAME:
             g_value_set_string (value, self->omx_library);
             break;
+        case ARG_COMPONENT_ROLE:
+            g_value_set_string (value, self->omx_role);
+            break;
         case ARG_USE_TIMESTAMPS:
             g_value_set_boolean (value, self->use_timestamps);
             break;
+        case ARG_STALL_TIMEOUT:
+            g_value_set_uint (value, self->gomx->timeout / 1000);
+            break;
+        case ARG_STALL_RESET:
+            g_value_set_boolean (value, self->gomx->reset_on_stall);
+            break;
+        case ARG_SHARED_OUTPUT:
+            g_value_set_boolean (value, self->shared_output);
+            break;
+        case ARG_OUTPUT_LOW_WATERMARK:
+            g_value_set_uint (value, self->out_low_watermark);
+            break;
+        case ARG_OUTPUT_HIGH_WATERMARK:
+            g_value_set_uint (value, self->out_high_watermark);
+            break;
+        case ARG_SPIN_COUNT:
+            g_value_set_uint (value, self->gomx->spin);
+            break;
+        case ARG_INPUT_BUFFERS:
+            g_value_set_int (value, self->in_count.wanted);
+            break;
+        case ARG_OUTPUT_BUFFERS:
+            g_value_set_int (value, self->out_count.wanted);
+            break;
+        case ARG_INPUT_ALLOCATION:
+            g_value_set_enum (value, self->in_allocation);
+            break;
+        case ARG_OUTPUT_ALLOCATION:
+            g_value_set_enum (value, self->out_allocation);
+            break;
+        case ARG_PREFAULT_BUFFERS:
+            g_value_set_boolean (value, self->gomx->prefault);
+            break;
+        case ARG_ZERO_COPY_INPUT:
+            g_value_set_boolean (value, self->zero_copy_input);
+            break;
+        case ARG_AGGREGATE_BYTES:
+            g_value_set_uint (value, self->aggregate_bytes);
+            break;
+        case ARG_AGGREGATE_TIME:
+            g_value_set_uint64 (value, self->aggregate_time);
+            break;
+        case ARG_INPUT_QUEUE_BUFFERS:
+            g_value_set_uint (value, self->in_queue_buffers);
+            break;
+        case ARG_INPUT_QUEUE_BYTES:
+            g_value_set_uint (value, self->in_queue_bytes);
+            break;
+        case ARG_INPUT_QUEUE_TIME:
+            g_value_set_uint64 (value, self->in_queue_time);
+            break;
+        case ARG_DIRECT_PUSH:
+            g_value_set_boolean (value, self->direct_push);
+            break;
+        case ARG_LOW_LATENCY:
+            g_value_set_boolean (value, self->low_latency);
+            break;
+        case ARG_STATS:
+            {
+                GstStructure *stats;
+
+                stats = gstomx_get_stats (self->gomx);
+                gst_structure_set (stats,
+                                   "input-processed", G_TYPE_UINT, self->processed,
+                                   "input-dropped", G_TYPE_UINT, self->dropped,
+                                   NULL);
+                g_value_take_boxed (value, stats);
+                break;
+            }
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -236,13 +715,118 @@ type_class_init (gpointer g_class,
 
         g_object_class_install_property (gobject_class, ARG_LIBRARY_NAME,
                                          g_param_spec_string ("library-name", "Library name",
-                                                              "Name of the OpenMAX IL implementation library to use",
+                                                              "OpenMAX IL implementation libraries to try, separated by ':'; \"auto\" tries the known ones",
+                                                              NULL, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_COMPONENT_ROLE,
+                                         g_param_spec_string ("component-role", "Component role",
+                                                              "Standard role the component should take (NULL = its default)",
                                                               NULL, G_PARAM_READWRITE));
 
         g_object_class_install_property (gobject_class, ARG_USE_TIMESTAMPS,
                                          g_param_spec_boolean ("use-timestamps", "Use timestamps",
                                                                "Whether or not to use timestamps",
                                                                TRUE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_STALL_TIMEOUT,
+                                         g_param_spec_uint ("stall-timeout", "Stall timeout",
+                                                            "Milliseconds the component may sit on input without returning buffers before it's considered stalled (0 = wait forever)",
+                                                            0, G_MAXUINT / 1000, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_STALL_RESET,
+                                         g_param_spec_boolean ("stall-reset", "Stall reset",
+                                                               "Whether or not to flush the component when it stalls",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_SHARED_OUTPUT,
+                                         g_param_spec_boolean ("shared-output", "Shared output",
+                                                               "Push output from threads shared with other elements instead of a task of our own",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_OUTPUT_LOW_WATERMARK,
+                                         g_param_spec_uint ("output-low-watermark", "Output low watermark",
+                                                            "Filled buffers waiting to be pushed at which input is accepted again",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_OUTPUT_HIGH_WATERMARK,
+                                         g_param_spec_uint ("output-high-watermark", "Output high watermark",
+                                                            "Filled buffers waiting to be pushed at which input is held back (0 = never)",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_SPIN_COUNT,
+                                         g_param_spec_uint ("spin-count", "Spin count",
+                                                            "Maximum iterations to busy-wait for the component before sleeping (0 = don't spin)",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_PREFAULT_BUFFERS,
+                                         g_param_spec_boolean ("prefault-buffers", "Prefault buffers",
+                                                               "Touch the buffers' memory when allocating it, so the first frames don't page fault",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_INPUT_ALLOCATION,
+                                         g_param_spec_enum ("input-allocation", "Input allocation",
+                                                            "Who allocates the input buffers",
+                                                            GST_OMX_TYPE_ALLOCATION, GOMX_ALLOCATION_USE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_OUTPUT_ALLOCATION,
+                                         g_param_spec_enum ("output-allocation", "Output allocation",
+                                                            "Who allocates the output buffers",
+                                                            GST_OMX_TYPE_ALLOCATION, GOMX_ALLOCATION_USE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_INPUT_BUFFERS,
+                                         g_param_spec_int ("input-buffers", "Input buffers",
+                                                           "Buffers on the input port (0 = what the component suggests, -1 = tune automatically)",
+                                                           -1, G_MAXINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_OUTPUT_BUFFERS,
+                                         g_param_spec_int ("output-buffers", "Output buffers",
+                                                           "Buffers on the output port (0 = what the component suggests, -1 = tune automatically)",
+                                                           -1, G_MAXINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_ZERO_COPY_INPUT,
+                                         g_param_spec_boolean ("zero-copy-input", "Zero-copy input",
+                                                               "Hand upstream's data to the component instead of copying it, when it fits the input port",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_AGGREGATE_BYTES,
+                                         g_param_spec_uint ("aggregate-bytes", "Aggregate bytes",
+                                                            "Pack consecutive input buffers into one of up to this many bytes (0 = as many as fit, if aggregate-time is set)",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_AGGREGATE_TIME,
+                                         g_param_spec_uint64 ("aggregate-time", "Aggregate time",
+                                                              "Pack consecutive input buffers into one spanning up to this many nanoseconds (0 = no limit, if aggregate-bytes is set)",
+                                                              0, G_MAXUINT64, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_INPUT_QUEUE_BUFFERS,
+                                         g_param_spec_uint ("input-queue-buffers", "Input queue buffers",
+                                                            "Queue up to this many input buffers, and submit them from a thread of our own (0 = no limit; no queue unless another limit is set)",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_INPUT_QUEUE_BYTES,
+                                         g_param_spec_uint ("input-queue-bytes", "Input queue bytes",
+                                                            "Queue up to this many bytes of input (0 = no limit)",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_INPUT_QUEUE_TIME,
+                                         g_param_spec_uint64 ("input-queue-time", "Input queue time",
+                                                              "Queue up to this many nanoseconds of input (0 = no limit)",
+                                                              0, G_MAXUINT64, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_DIRECT_PUSH,
+                                         g_param_spec_boolean ("direct-push", "Direct push",
+                                                               "Push output from the component's callback instead of an output task; for components that call back synchronously, or from a thread they don't need back soon",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_LOW_LATENCY,
+                                         g_param_spec_boolean ("low-latency", "Low latency",
+                                                               "Use the fewest buffers the component takes, never pack input, mark each input buffer as a complete frame, and add the component's delay to the pipeline's latency",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_STATS,
+                                         g_param_spec_boxed ("stats", "Statistics",
+                                                             "Port queue and semaphore statistics, and how much input was processed or dropped as too late",
+                                                             GST_TYPE_STRUCTURE, G_PARAM_READABLE));
     }
 }
 
@@ -260,241 +844,563 @@ push_buffer (GstOmxBaseFilter *self,
     return ret;
 }
 
-static void
-output_loop (gpointer data)
+/**
+ * Sends on the EOS event that was held back until the component drained;
+ * stream lock held. Returns FALSE if there was none.
+ */
+static gboolean
+forward_eos (GstOmxBaseFilter *self)
 {
-    GstPad *pad;
-    GOmxCore *gomx;
-    GOmxPort *out_port;
-    GstOmxBaseFilter *self;
-    GstFlowReturn ret = GST_FLOW_OK;
-
-    pad = data;
-    self = GST_OMX_BASE_FILTER (gst_pad_get_parent (pad));
-    gomx = self->gomx;
+    GstEvent *event;
 
-    GST_LOG_OBJECT (self, "begin");
+    event = take_eos (self);
+    if (!event)
+        return FALSE;
 
-    if (!self->initialized)
-    {
-        g_error ("not initialized");
-        return;
-    }
+    GST_DEBUG_OBJECT (self, "forwarding eos");
+    gst_pad_push_event (self->srcpad, event);
 
-    out_port = self->out_port;
+    return TRUE;
+}
 
-    if (G_LIKELY (out_port->enabled))
-    {
-        OMX_BUFFERHEADERTYPE *omx_buffer;
+/**
+ * Pushes the contents of omx_buffer downstream and hands it back to the
+ * component. Returns FALSE when the stream can't go on (flow error or EOS),
+ * in which case omx_buffer is not handed back; unless it was lent
+ * downstream, which hands it back by itself.
+ */
+static gboolean
+output_buffer (GstOmxBaseFilter *self,
+               OMX_BUFFERHEADERTYPE *omx_buffer,
+               GstFlowReturn *ret)
+{
+    GOmxCore *gomx;
+    GOmxPort *out_port;
+    gboolean lent = FALSE;
+    gboolean eos;
 
-        GST_LOG_OBJECT (self, "request buffer");
-        omx_buffer = g_omx_port_request_buffer (out_port);
+    gomx = self->gomx;
+    out_port = self->out_port;
 
-        GST_LOG_OBJECT (self, "omx_buffer: %p", omx_buffer);
+    /* Once lent and pushed, omx_buffer may be the component's again. */
+    eos = (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS);
 
-        if (G_UNLIKELY (!omx_buffer))
-        {
-            GST_WARNING_OBJECT (self, "null buffer: leaving");
-            goto leave;
-        }
+    GST_LOG_OBJECT (self, "omx_buffer: %p", omx_buffer);
 
-        GST_DEBUG_OBJECT (self, "omx_buffer: size=%lu, len=%lu, flags=%lu, offset=%lu, timestamp=%lld",
-                          omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nFlags,
-                          omx_buffer->nOffset, omx_buffer->nTimeStamp);
+    GST_DEBUG_OBJECT (self, "omx_buffer: size=%lu, len=%lu, flags=%lu, offset=%lu, timestamp=%lld",
+                      omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nFlags,
+                      omx_buffer->nOffset, omx_buffer->nTimeStamp);
 
-        if (G_LIKELY (omx_buffer->nFilledLen > 0))
-        {
-            GstBuffer *buf;
+    if (G_LIKELY (omx_buffer->nFilledLen > 0))
+    {
+        GstBuffer *buf;
 
 #if 1
-            /** @todo remove this check */
-            if (G_LIKELY (self->in_port->enabled))
-            {
-                GstCaps *caps = NULL;
-
-                caps = gst_pad_get_negotiated_caps (self->srcpad);
-
-                if (!caps)
-                {
-                    /** @todo We shouldn't be doing this. */
-                    GST_WARNING_OBJECT (self, "faking settings changed notification");
-                    if (gomx->settings_changed_cb)
-                        gomx->settings_changed_cb (gomx);
-                }
-                else
-                {
-                    GST_LOG_OBJECT (self, "caps already fixed: %" GST_PTR_FORMAT, caps);
-                    gst_caps_unref (caps);
-                }
-            }
-#endif
+        /** @todo remove this check */
+        if (G_LIKELY (self->in_port->enabled))
+        {
+            GstCaps *caps = NULL;
 
-            /* buf is always null when the output buffer pointer isn't shared. */
-            buf = omx_buffer->pAppPrivate;
+            caps = gst_pad_get_negotiated_caps (self->srcpad);
 
-            if (buf && !(omx_buffer->nFlags & OMX_BUFFERFLAG_EOS))
+            if (!caps)
             {
-                GST_BUFFER_SIZE (buf) = omx_buffer->nFilledLen;
-                if (self->use_timestamps)
-                {
-                    GST_BUFFER_TIMESTAMP (buf) = gst_util_uint64_scale_int (omx_buffer->nTimeStamp,
-                                                                            GST_SECOND,
-                                                                            OMX_TICKS_PER_SECOND);
-                }
-
-                omx_buffer->pAppPrivate = NULL;
-                omx_buffer->pBuffer = NULL;
-                omx_buffer->nFilledLen = 0;
-
-                ret = push_buffer (self, buf);
-
-                gst_buffer_unref (buf);
+                /** @todo We shouldn't be doing this. */
+                GST_WARNING_OBJECT (self, "faking settings changed notification");
+                if (gomx->settings_changed_cb)
+                    gomx->settings_changed_cb (gomx);
             }
             else
             {
-                /* This is only meant for the first OpenMAX buffers,
-                 * which need to be pre-allocated. */
-                /* Also for the very last one. */
-                gst_pad_alloc_buffer_and_set_caps (self->srcpad,
-                                                   GST_BUFFER_OFFSET_NONE,
-                                                   omx_buffer->nFilledLen,
-                                                   GST_PAD_CAPS (self->srcpad),
-                                                   &buf);
-
-                if (G_LIKELY (buf))
-                {
-                    memcpy (GST_BUFFER_DATA (buf), omx_buffer->pBuffer + omx_buffer->nOffset, omx_buffer->nFilledLen);
-                    if (self->use_timestamps)
-                    {
-                        GST_BUFFER_TIMESTAMP (buf) = gst_util_uint64_scale (omx_buffer->nTimeStamp,
-                                                                            GST_SECOND,
-                                                                            OMX_TICKS_PER_SECOND);
-                    }
-
-                    omx_buffer->nFilledLen = 0;
-
-                    if (share_output_buffer)
-                    {
-                        GST_WARNING_OBJECT (self, "couldn't zero-copy");
-                        g_free (omx_buffer->pBuffer);
-                        omx_buffer->pBuffer = NULL;
-                    }
-
-                    ret = push_buffer (self, buf);
-                }
-                else
-                {
-                    GST_WARNING_OBJECT (self, "couldn't allocate buffer of size %d",
-                                        omx_buffer->nFilledLen);
-                }
+                GST_LOG_OBJECT (self, "caps already fixed: %" GST_PTR_FORMAT, caps);
+                gst_caps_unref (caps);
             }
         }
-        else
-        {
-            GST_WARNING_OBJECT (self, "empty buffer");
-        }
+#endif
 
-        if (G_UNLIKELY (ret != GST_FLOW_OK))
-            goto leave;
+        /* Downstream gets the component's buffer itself if the port can
+         * spare it; it goes back to the component once unreffed. */
+        buf = gst_omx_buffer_new (out_port, omx_buffer);
 
-        if (G_UNLIKELY (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS))
+        if (G_LIKELY (buf))
         {
-            GST_DEBUG_OBJECT (self, "got eos");
-            g_omx_core_set_done (gomx);
-            goto leave;
+            lent = TRUE;
+            gst_buffer_set_caps (buf, GST_PAD_CAPS (self->srcpad));
         }
-
-        if (share_output_buffer &&
-            !omx_buffer->pBuffer &&
-            omx_buffer->nOffset == 0)
+        else
         {
-            GstBuffer *buf;
-            GstFlowReturn result;
+            gst_pad_alloc_buffer_and_set_caps (self->srcpad,
+                                               GST_BUFFER_OFFSET_NONE,
+                                               omx_buffer->nFilledLen,
+                                               GST_PAD_CAPS (self->srcpad),
+                                               &buf);
 
-            GST_LOG_OBJECT (self, "allocate buffer");
-            result = gst_pad_alloc_buffer_and_set_caps (self->srcpad,
-                                                        GST_BUFFER_OFFSET_NONE,
-                                                        omx_buffer->nAllocLen,
-                                                        GST_PAD_CAPS (self->srcpad),
-                                                        &buf);
-
-            if (G_LIKELY (result == GST_FLOW_OK))
+            if (G_LIKELY (buf))
             {
-                gst_buffer_ref (buf);
-                omx_buffer->pAppPrivate = buf;
-
-                omx_buffer->pBuffer = GST_BUFFER_DATA (buf);
-                omx_buffer->nAllocLen = GST_BUFFER_SIZE (buf);
+                memcpy (GST_BUFFER_DATA (buf), omx_buffer->pBuffer + omx_buffer->nOffset, omx_buffer->nFilledLen);
+                omx_buffer->nFilledLen = 0;
             }
-            else
+        }
+
+        if (G_LIKELY (buf))
+        {
+            if (self->use_timestamps)
             {
-                GST_WARNING_OBJECT (self, "could not pad allocate buffer, using malloc");
-                omx_buffer->pBuffer = g_malloc (omx_buffer->nAllocLen);
+                GST_BUFFER_TIMESTAMP (buf) = gst_util_uint64_scale (omx_buffer->nTimeStamp,
+                                                                    GST_SECOND,
+                                                                    OMX_TICKS_PER_SECOND);
             }
-        }
 
-        if (share_output_buffer &&
-            !omx_buffer->pBuffer)
+            *ret = push_buffer (self, buf);
+        }
+        else
         {
-            GST_WARNING_OBJECT (self, "no input buffer to share");
+            GST_WARNING_OBJECT (self, "couldn't allocate buffer of size %d",
+                                omx_buffer->nFilledLen);
         }
-
-        GST_LOG_OBJECT (self, "release_buffer");
-        g_omx_port_release_buffer (out_port, omx_buffer);
+    }
+    else
+    {
+        GST_WARNING_OBJECT (self, "empty buffer");
     }
 
-    self->last_pad_push_return = ret;
-
-leave:
+    if (G_UNLIKELY (*ret != GST_FLOW_OK))
+        return FALSE;
 
-    if (ret != GST_FLOW_OK)
+    if (G_UNLIKELY (eos))
     {
-        GST_INFO_OBJECT (self, "pause task, reason:  %s",
-                         gst_flow_get_name (self->last_pad_push_return));
-        gst_pad_pause_task (self->srcpad);
+        GST_DEBUG_OBJECT (self, "got eos");
+        forward_eos (self);
+        return FALSE;
     }
 
-    GST_LOG_OBJECT (self, "end");
+    if (lent)
+        return TRUE;
 
-    gst_object_unref (self);
+    GST_LOG_OBJECT (self, "release_buffer");
+    g_omx_port_release_buffer (out_port, omx_buffer);
+
+    return TRUE;
 }
 
-static GstFlowReturn
-pad_chain (GstPad *pad,
-           GstBuffer *buf)
+/**
+ * Pushes count buffers from batch. Returns FALSE when the stream can't go
+ * on, after handing the ones that weren't pushed back to the component.
+ */
+static gboolean
+output_buffers (GstOmxBaseFilter *self,
+                OMX_BUFFERHEADERTYPE **batch,
+                guint count,
+                GstFlowReturn *ret)
 {
-    GOmxCore *gomx;
-    GOmxPort *in_port;
+    guint i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (G_UNLIKELY (!output_buffer (self, batch[i], ret)))
+            break;
+    }
+
+    if (G_UNLIKELY (i < count))
+    {
+        for (i++; i < count; i++)
+        {
+            batch[i]->nFilledLen = 0;
+            g_omx_port_release_buffer (self->out_port, batch[i]);
+        }
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+output_loop (gpointer data)
+{
+    GstPad *pad;
+    GOmxPort *out_port;
     GstOmxBaseFilter *self;
     GstFlowReturn ret = GST_FLOW_OK;
 
-    self = GST_OMX_BASE_FILTER (GST_OBJECT_PARENT (pad));
-
-    gomx = self->gomx;
+    pad = data;
+    self = GST_OMX_BASE_FILTER (gst_pad_get_parent (pad));
 
     GST_LOG_OBJECT (self, "begin");
-    GST_LOG_OBJECT (self, "gst_buffer: size=%lu", GST_BUFFER_SIZE (buf));
 
-    GST_LOG_OBJECT (self, "state: %d", gomx->omx_state);
+    if (!self->initialized)
+    {
+        g_error ("not initialized");
+        return;
+    }
 
-    if (G_UNLIKELY (gomx->omx_state == OMX_StateLoaded))
+    out_port = self->out_port;
+
+    if (G_LIKELY (out_port->enabled))
     {
-        GST_INFO_OBJECT (self, "omx: prepare");
+        guint count;
+
+        /* Take everything the component has filled in one go. */
+        GST_LOG_OBJECT (self, "request buffers");
+        count = g_omx_port_request_buffers (out_port, self->out_batch, out_port->num_buffers);
+
+        GST_LOG_OBJECT (self, "got %u buffers", count);
+
+        if (G_UNLIKELY (count == 0))
+        {
+            GST_WARNING_OBJECT (self, "null buffer: leaving");
+            goto leave;
+        }
+
+        if (G_UNLIKELY (!output_buffers (self, self->out_batch, count, &ret)))
+            goto leave;
+    }
+
+    self->last_pad_push_return = ret;
+
+leave:
+
+    if (ret != GST_FLOW_OK)
+    {
+        GST_INFO_OBJECT (self, "pause task, reason:  %s",
+                         gst_flow_get_name (self->last_pad_push_return));
+        gst_pad_pause_task (self->srcpad);
+    }
+
+    GST_LOG_OBJECT (self, "end");
+
+    gst_object_unref (self);
+}
+
+/**
+ * Called from the dispatcher's pool when the output port has buffers; does
+ * what an iteration of output_loop would, but doesn't wait for buffers.
+ * The push may block; that only holds up this element.
+ */
+static void
+output_ready (gpointer data)
+{
+    GOmxPort *out_port;
+    GstOmxBaseFilter *self;
+    GstFlowReturn ret = GST_FLOW_OK;
+    guint count;
+
+    self = data;
+    out_port = self->out_port;
+
+    GST_PAD_STREAM_LOCK (self->srcpad);
+
+    count = g_omx_port_try_request_buffers (out_port, self->out_batch, out_port->num_buffers);
+
+    GST_LOG_OBJECT (self, "got %u buffers", count);
+
+    if (G_LIKELY (output_buffers (self, self->out_batch, count, &ret)))
+        self->last_pad_push_return = ret;
+
+    if (ret != GST_FLOW_OK)
+    {
+        GST_INFO_OBJECT (self, "stop output, reason:  %s",
+                         gst_flow_get_name (self->last_pad_push_return));
+        dispatcher_remove (g_omx_get_dispatcher (), self->out_fd);
+    }
+
+    GST_PAD_STREAM_UNLOCK (self->srcpad);
+}
+
+/**
+ * Outputs whatever waits in the output queue. With direct-push, buffers
+ * only end up there while the output is stopped, or when the component
+ * calls back from inside one of our own pushes. Stream lock held.
+ */
+static gboolean
+output_queued (GstOmxBaseFilter *self,
+               GstFlowReturn *ret)
+{
+    guint count;
+
+    while ((count = g_omx_port_try_request_buffers (self->out_port, self->out_batch,
+                                                    self->out_port->num_buffers)) > 0)
+    {
+        GST_LOG_OBJECT (self, "got %u queued buffers", count);
+
+        if (!output_buffers (self, self->out_batch, count, ret))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * With direct-push, the component's callback hands the output buffers
+ * here, and they are pushed right away, from the component's thread; no
+ * queue, no output task. Returns FALSE to have omx_buffer queued instead:
+ * while the output is stopped, or when called back from inside our own
+ * push, which then outputs it once done.
+ */
+static gboolean
+output_direct (GOmxPort *port,
+               OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    GstOmxBaseFilter *self;
+    GstFlowReturn ret = GST_FLOW_OK;
+    gboolean ok;
+
+    self = port->core->client_data;
+
+    if (self->direct_thread == g_thread_self ())
+        return FALSE;
+
+    if (!g_atomic_int_get (&self->direct_active) || GST_PAD_IS_FLUSHING (self->srcpad))
+        return FALSE;
+
+    GST_PAD_STREAM_LOCK (self->srcpad);
+
+    self->direct_thread = g_thread_self ();
+
+    /* Whatever is queued came first. */
+    if (G_UNLIKELY (!g_atomic_int_get (&self->direct_active) ||
+                    !output_queued (self, &ret)))
+    {
+        self->direct_thread = NULL;
+        GST_PAD_STREAM_UNLOCK (self->srcpad);
+        return FALSE;
+    }
+
+    ok = output_buffers (self, &omx_buffer, 1, &ret) &&
+         output_queued (self, &ret);
+
+    if (G_LIKELY (ok))
+    {
+        self->last_pad_push_return = ret;
+    }
+    else
+    {
+        GST_INFO_OBJECT (self, "stop output, reason:  %s", gst_flow_get_name (ret));
+        g_atomic_int_set (&self->direct_active, FALSE);
+    }
+
+    self->direct_thread = NULL;
+    GST_PAD_STREAM_UNLOCK (self->srcpad);
+
+    return TRUE;
+}
+
+/**
+ * Output is pushed either from the srcpad task, or, with shared-output, from
+ * whichever dispatcher thread sees the output port become readable; or, with
+ * direct-push, from the component's callbacks.
+ */
+static gboolean
+start_output (GstOmxBaseFilter *self)
+{
+    self->out_port->direct_cb = self->direct_push ? output_direct : NULL;
+    self->out_port->done_cb = self->low_latency ? output_done : NULL;
+
+    if (self->direct_push)
+    {
+        g_atomic_int_set (&self->direct_active, TRUE);
+        return TRUE;
+    }
+
+    if (self->shared_output)
+    {
+        Dispatcher *dispatcher;
+        gint fd;
+
+        dispatcher = g_omx_get_dispatcher ();
+        fd = g_omx_port_get_fd (self->out_port);
+
+        if (dispatcher && fd >= 0 &&
+            dispatcher_add (dispatcher, fd, output_ready, self))
+        {
+            self->out_fd = fd;
+            return TRUE;
+        }
+
+        GST_WARNING_OBJECT (self, "shared output not available, using a task");
+    }
+
+    return gst_pad_start_task (self->srcpad, output_loop, self->srcpad);
+}
+
+static gboolean
+stop_output (GstOmxBaseFilter *self,
+             gboolean pause)
+{
+    if (self->out_fd >= 0)
+    {
+        dispatcher_remove (g_omx_get_dispatcher (), self->out_fd);
+        self->out_fd = -1;
+    }
+
+    if (g_atomic_int_get (&self->direct_active))
+    {
+        g_atomic_int_set (&self->direct_active, FALSE);
+
+        /* Let a push in progress finish; when pausing it may be what we
+         * are about to unblock. */
+        if (!pause)
+        {
+            GST_PAD_STREAM_LOCK (self->srcpad);
+            GST_PAD_STREAM_UNLOCK (self->srcpad);
+        }
+    }
+
+    if (pause)
+        return gst_pad_pause_task (self->srcpad);
+    else
+        return gst_pad_stop_task (self->srcpad);
+}
+
+static void
+stalled_cb (GOmxCore *core)
+{
+    GstOmxBaseFilter *self;
+    GstEvent *event;
+
+    self = core->client_data;
+
+    GST_ELEMENT_WARNING (self, STREAM, FAILED, (NULL),
+                         ("OpenMAX component stalled for %lu ms; "
+                          "input: %u queued, %d in component; "
+                          "output: %u queued, %d in component",
+                          core->timeout / 1000,
+                          async_queue_length (self->in_port->queue),
+                          g_atomic_int_get (&self->in_port->component_buffers),
+                          async_queue_length (self->out_port->queue),
+                          g_atomic_int_get (&self->out_port->component_buffers)));
+
+    /* A component that doesn't drain doesn't get to hold back EOS. */
+    event = take_eos (self);
+    if (event)
+    {
+        GST_WARNING_OBJECT (self, "sending eos without the component's");
+
+        g_omx_port_disable (self->out_port);
+        stop_output (self, TRUE);
+
+        GST_PAD_STREAM_LOCK (self->srcpad);
+        gst_pad_push_event (self->srcpad, event);
+        GST_PAD_STREAM_UNLOCK (self->srcpad);
+    }
+}
+
+/** Input buffers this far apart from where the previous ones end still follow on. */
+#define AGGREGATE_JITTER GST_MSECOND
+
+/** Sends the input packed so far. */
+static void
+send_pending (GstOmxBaseFilter *self)
+{
+    OMX_BUFFERHEADERTYPE *omx_buffer;
+
+    omx_buffer = self->pending;
+    if (!omx_buffer)
+        return;
+
+    self->pending = NULL;
+
+    GST_LOG_OBJECT (self, "release packed buffer: %lu bytes", omx_buffer->nFilledLen);
+    g_omx_port_release_buffer (self->in_port, omx_buffer);
+}
 
-        /** @todo this should probably go after doing preparations. */
-        if (self->omx_setup)
+/**
+ * Packs buf into the pending input buffer, after the ones before it. What's
+ * pending is sent first if buf doesn't fit, or doesn't follow on from it in
+ * time; and right after, if it reached aggregate-time. Returns FALSE if buf
+ * is too big to be packed at all, or there was no input buffer to pack it
+ * into; it has to go on its own then, which also deals with the latter.
+ */
+static gboolean
+aggregate (GstOmxBaseFilter *self,
+           GstBuffer *buf)
+{
+    OMX_BUFFERHEADERTYPE *omx_buffer;
+    GstClockTime timestamp;
+    gulong limit;
+
+    timestamp = GST_BUFFER_TIMESTAMP (buf);
+
+    limit = self->in_port->buffer_size;
+    if (self->aggregate_bytes)
+        limit = MIN (limit, self->aggregate_bytes);
+
+    omx_buffer = self->pending;
+
+    if (omx_buffer &&
+        (omx_buffer->nFilledLen + GST_BUFFER_SIZE (buf) > limit ||
+         GST_BUFFER_IS_DISCONT (buf) ||
+         (GST_CLOCK_TIME_IS_VALID (timestamp) &&
+          GST_CLOCK_TIME_IS_VALID (self->pending_end) &&
+          MAX (timestamp, self->pending_end) - MIN (timestamp, self->pending_end) > AGGREGATE_JITTER)))
+    {
+        send_pending (self);
+        omx_buffer = NULL;
+    }
+
+    if (GST_BUFFER_SIZE (buf) > limit)
+        return FALSE;
+
+    if (!omx_buffer)
+    {
+        if (G_UNLIKELY (self->backpressure))
+            wait_for_output (self);
+
+        GST_LOG_OBJECT (self, "request buffer");
+        omx_buffer = g_omx_port_request_buffer (self->in_port);
+
+        if (G_UNLIKELY (!omx_buffer))
+        {
+            GST_WARNING_OBJECT (self, "null buffer");
+            return FALSE;
+        }
+
+        omx_buffer->nFilledLen = 0;
+
+        if (self->use_timestamps)
         {
-            self->omx_setup (self);
+            omx_buffer->nTimeStamp = gst_util_uint64_scale_int (timestamp,
+                                                                OMX_TICKS_PER_SECOND,
+                                                                GST_SECOND);
         }
 
-        setup_ports (self);
+        self->pending = omx_buffer;
+        self->pending_start = timestamp;
+    }
+
+    memcpy (omx_buffer->pBuffer + omx_buffer->nOffset + omx_buffer->nFilledLen,
+            GST_BUFFER_DATA (buf), GST_BUFFER_SIZE (buf));
+    omx_buffer->nFilledLen += GST_BUFFER_SIZE (buf);
 
-        g_omx_core_prepare (self->gomx);
+    if (GST_CLOCK_TIME_IS_VALID (timestamp) && GST_BUFFER_DURATION_IS_VALID (buf))
+        self->pending_end = timestamp + GST_BUFFER_DURATION (buf);
+    else
+        self->pending_end = GST_CLOCK_TIME_NONE;
 
-        self->initialized = TRUE;
-        gst_pad_start_task (self->srcpad, output_loop, self->srcpad);
+    if (self->aggregate_time &&
+        GST_CLOCK_TIME_IS_VALID (self->pending_start) &&
+        GST_CLOCK_TIME_IS_VALID (self->pending_end) &&
+        self->pending_end - self->pending_start >= self->aggregate_time)
+    {
+        send_pending (self);
     }
 
+    return TRUE;
+}
+
+/**
+ * Fills input buffers with buf and hands them to the component; takes
+ * buf. Runs in the streaming thread, or in the input thread if there is an
+ * input queue.
+ */
+static GstFlowReturn
+submit_input (GstOmxBaseFilter *self,
+              GstBuffer *buf)
+{
+    GOmxCore *gomx;
+    GOmxPort *in_port;
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    gomx = self->gomx;
     in_port = self->in_port;
 
     if (G_LIKELY (in_port->enabled))
@@ -512,6 +1418,23 @@ pad_chain (GstPad *pad,
             GST_ERROR_OBJECT (self, "Whoa! very wrong");
         }
 
+        /* Small buffers are packed together; the rest go after them. */
+        if ((self->aggregate_bytes || self->aggregate_time) && !self->low_latency)
+        {
+            if (self->last_pad_push_return != GST_FLOW_OK)
+            {
+                goto out_flushing;
+            }
+
+            if (aggregate (self, buf))
+                buffer_offset = GST_BUFFER_SIZE (buf);
+        }
+        else
+        {
+            /* In case packing was just turned off. */
+            send_pending (self);
+        }
+
         while (G_LIKELY (buffer_offset < GST_BUFFER_SIZE (buf)))
         {
             OMX_BUFFERHEADERTYPE *omx_buffer;
@@ -521,6 +1444,9 @@ pad_chain (GstPad *pad,
                 goto out_flushing;
             }
 
+            if (G_UNLIKELY (self->backpressure))
+                wait_for_output (self);
+
             GST_LOG_OBJECT (self, "request buffer");
             omx_buffer = g_omx_port_request_buffer (in_port);
 
@@ -532,27 +1458,14 @@ pad_chain (GstPad *pad,
                                   omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nFlags,
                                   omx_buffer->nOffset, omx_buffer->nTimeStamp);
 
-                if (omx_buffer->nOffset == 0 &&
-                    share_input_buffer)
+                /* The component reads upstream's data itself if it can. */
+                if (buffer_offset == 0 && self->zero_copy_input &&
+                    g_omx_port_borrow_data (in_port, omx_buffer,
+                                            GST_BUFFER_DATA (buf), GST_BUFFER_SIZE (buf),
+                                            buf, (GDestroyNotify) gst_buffer_unref))
                 {
-                    {
-                        GstBuffer *old_buf;
-                        old_buf = omx_buffer->pAppPrivate;
-
-                        if (old_buf)
-                        {
-                            gst_buffer_unref (old_buf);
-                        }
-                        else if (omx_buffer->pBuffer)
-                        {
-                            g_free (omx_buffer->pBuffer);
-                        }
-                    }
-
-                    omx_buffer->pBuffer = GST_BUFFER_DATA (buf);
-                    omx_buffer->nAllocLen = GST_BUFFER_SIZE (buf);
-                    omx_buffer->nFilledLen = GST_BUFFER_SIZE (buf);
-                    omx_buffer->pAppPrivate = buf;
+                    /* Until the component is done with it. */
+                    gst_buffer_ref (buf);
                 }
                 else
                 {
@@ -570,6 +1483,20 @@ pad_chain (GstPad *pad,
 
                 buffer_offset += omx_buffer->nFilledLen;
 
+                /* In low-latency mode every input buffer is a whole frame;
+                 * the component needn't wait for more to start on it. */
+                if (self->low_latency && buffer_offset >= GST_BUFFER_SIZE (buf))
+                {
+                    omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+
+                    if (self->use_timestamps && GST_BUFFER_TIMESTAMP_IS_VALID (buf))
+                        latency_in (self, omx_buffer->nTimeStamp);
+                }
+                else
+                {
+                    omx_buffer->nFlags &= ~OMX_BUFFERFLAG_ENDOFFRAME;
+                }
+
                 GST_LOG_OBJECT (self, "release_buffer");
                 /** @todo untaint buffer */
                 g_omx_port_release_buffer (in_port, omx_buffer);
@@ -587,21 +1514,301 @@ pad_chain (GstPad *pad,
         ret = GST_FLOW_UNEXPECTED;
     }
 
-    if (!share_input_buffer)
+    gst_buffer_unref (buf);
+
+    return ret;
+
+    /* special conditions */
+out_flushing:
     {
         gst_buffer_unref (buf);
+        /* Not submitted; upstream mustn't think it was. */
+        if (self->last_pad_push_return == GST_FLOW_OK)
+            return GST_FLOW_WRONG_STATE;
+        return self->last_pad_push_return;
     }
+}
 
-    GST_LOG_OBJECT (self, "end");
+/* Whether the input queue has reached any of its limits; in_mutex held. */
+static gboolean
+input_queue_full (GstOmxBaseFilter *self)
+{
+    GstBuffer *first;
+    GstBuffer *last;
+
+    if (g_queue_is_empty (self->in_queue))
+        return FALSE;
+
+    if (self->in_queue_buffers && g_queue_get_length (self->in_queue) >= self->in_queue_buffers)
+        return TRUE;
+
+    if (self->in_queue_bytes && self->in_queued_bytes >= self->in_queue_bytes)
+        return TRUE;
+
+    first = g_queue_peek_head (self->in_queue);
+    last = g_queue_peek_tail (self->in_queue);
+
+    if (self->in_queue_time &&
+        GST_BUFFER_TIMESTAMP_IS_VALID (first) &&
+        GST_BUFFER_TIMESTAMP_IS_VALID (last) &&
+        GST_BUFFER_TIMESTAMP (last) >= GST_BUFFER_TIMESTAMP (first) &&
+        GST_BUFFER_TIMESTAMP (last) - GST_BUFFER_TIMESTAMP (first) >= self->in_queue_time)
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Submits the queued input, so a slow component holds up this thread
+ * instead of upstream's. The first flow error is kept for pad_chain to
+ * return; what's queued after it is dropped, and nothing more is taken
+ * until a flush clears the error.
+ */
+static gpointer
+input_thread (gpointer data)
+{
+    GstOmxBaseFilter *self;
+
+    self = data;
+
+    g_mutex_lock (self->in_mutex);
+
+    while (TRUE)
+    {
+        GstBuffer *buf;
+        GstFlowReturn ret;
+
+        while (!self->in_quit &&
+               (g_queue_is_empty (self->in_queue) ||
+                self->in_flushing || self->in_return != GST_FLOW_OK))
+        {
+            g_cond_wait (self->in_cond, self->in_mutex);
+        }
+
+        if (self->in_quit)
+            break;
+
+        buf = g_queue_pop_head (self->in_queue);
+        self->in_queued_bytes -= GST_BUFFER_SIZE (buf);
+        self->in_busy = TRUE;
+        g_cond_broadcast (self->in_cond);
+
+        g_mutex_unlock (self->in_mutex);
+        ret = submit_input (self, buf);
+        g_mutex_lock (self->in_mutex);
+
+        self->in_busy = FALSE;
+        if (ret != GST_FLOW_OK && !self->in_flushing && self->in_return == GST_FLOW_OK)
+        {
+            self->in_return = ret;
+            input_queue_clear (self);
+        }
+        g_cond_broadcast (self->in_cond);
+    }
+
+    g_mutex_unlock (self->in_mutex);
+
+    return NULL;
+}
+
+/**
+ * Queues buf for the input thread, starting it if needed; only blocks
+ * while the queue is full.
+ */
+static GstFlowReturn
+queue_input (GstOmxBaseFilter *self,
+             GstBuffer *buf)
+{
+    GstFlowReturn ret;
+
+    g_mutex_lock (self->in_mutex);
+
+    if (G_UNLIKELY (!self->in_thread && !self->in_flushing))
+    {
+        self->in_return = GST_FLOW_OK;
+        self->in_thread = g_thread_create (input_thread, self, TRUE, NULL);
+    }
+
+    while (!self->in_flushing && self->in_return == GST_FLOW_OK &&
+           input_queue_full (self))
+    {
+        GST_LOG_OBJECT (self, "input queue full");
+        g_cond_wait (self->in_cond, self->in_mutex);
+    }
+
+    if (G_UNLIKELY (self->in_flushing))
+        ret = GST_FLOW_WRONG_STATE;
+    else
+        ret = self->in_return;
+
+    if (G_LIKELY (ret == GST_FLOW_OK))
+    {
+        g_queue_push_tail (self->in_queue, buf);
+        self->in_queued_bytes += GST_BUFFER_SIZE (buf);
+        g_cond_broadcast (self->in_cond);
+    }
+    else
+    {
+        gst_buffer_unref (buf);
+    }
+
+    g_mutex_unlock (self->in_mutex);
 
     return ret;
+}
 
-    /* special conditions */
-out_flushing:
+/**
+ * Waits until the input thread has submitted everything queued, or gave
+ * up on it. Either way it is out of submit_input when this returns, so the
+ * caller is the input port's only user.
+ */
+static void
+drain_input (GstOmxBaseFilter *self)
+{
+    g_mutex_lock (self->in_mutex);
+    while (self->in_busy ||
+           (!g_queue_is_empty (self->in_queue) &&
+            !self->in_flushing && self->in_return == GST_FLOW_OK))
+    {
+        g_cond_wait (self->in_cond, self->in_mutex);
+    }
+    g_mutex_unlock (self->in_mutex);
+}
+
+/**
+ * Whether buf should be skipped, because downstream's QoS says it would
+ * be too late anyway. Only frames nothing depends on are; once one is
+ * skipped, everything up to the next keyframe is too.
+ */
+static gboolean
+too_late (GstOmxBaseFilter *self,
+          GstBuffer *buf)
+{
+    GstClockTime earliest_time;
+    GstClockTime running_time;
+
+    if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT))
+    {
+        if (G_UNLIKELY (self->qos_resync))
+            GST_DEBUG_OBJECT (self, "resynced at keyframe");
+        self->qos_resync = FALSE;
+        return FALSE;
+    }
+
+    if (self->qos_resync)
+        goto drop;
+
+    GST_OBJECT_LOCK (self);
+    earliest_time = self->earliest_time;
+    GST_OBJECT_UNLOCK (self);
+
+    if (!GST_CLOCK_TIME_IS_VALID (earliest_time) || !GST_BUFFER_TIMESTAMP_IS_VALID (buf))
+        return FALSE;
+
+    running_time = gst_segment_to_running_time (&self->segment, GST_FORMAT_TIME,
+                                                GST_BUFFER_TIMESTAMP (buf));
+
+    if (!GST_CLOCK_TIME_IS_VALID (running_time))
+        return FALSE;
+
+    if (GST_BUFFER_DURATION_IS_VALID (buf))
+        running_time += GST_BUFFER_DURATION (buf);
+
+    if (running_time >= earliest_time)
+        return FALSE;
+
+    GST_DEBUG_OBJECT (self, "late by %" GST_TIME_FORMAT ", dropping until the next keyframe",
+                      GST_TIME_ARGS (earliest_time - running_time));
+    self->qos_resync = TRUE;
+
+drop:
+    self->dropped++;
+    return TRUE;
+}
+
+static GstFlowReturn
+pad_chain (GstPad *pad,
+           GstBuffer *buf)
+{
+    GOmxCore *gomx;
+    GstOmxBaseFilter *self;
+
+    self = GST_OMX_BASE_FILTER (GST_OBJECT_PARENT (pad));
+
+    gomx = self->gomx;
+
+    GST_LOG_OBJECT (self, "begin");
+    GST_LOG_OBJECT (self, "gst_buffer: size=%lu", GST_BUFFER_SIZE (buf));
+
+    GST_LOG_OBJECT (self, "state: %d", gomx->omx_state);
+
+    if (G_UNLIKELY (gomx->omx_state == OMX_StateLoaded))
+    {
+        GST_INFO_OBJECT (self, "omx: prepare");
+
+        while (TRUE)
+        {
+            GOmxStateChange *change;
+            gboolean prepared;
+
+            /** @todo this should probably go after doing preparations. */
+            if (self->omx_setup)
+            {
+                self->omx_setup (self);
+            }
+
+            setup_ports (self);
+
+            /* Let the component allocate while the output starts up. */
+            change = g_omx_core_prepare_async (gomx);
+
+            self->initialized = TRUE;
+            start_output (self);
+
+            prepared = g_omx_state_change_wait (change, gomx->timeout);
+            g_omx_state_change_free (change);
+
+            if (G_LIKELY (prepared))
+                break;
+
+            /* Out of resources; another library may have some. */
+            if (gomx->omx_error == OMX_ErrorInsufficientResources)
+            {
+                g_omx_port_finish (self->out_port);
+                stop_output (self, FALSE);
+                self->initialized = FALSE;
+
+                if (g_omx_core_failover (gomx))
+                {
+                    GST_WARNING_OBJECT (self, "falling back to %s", g_omx_core_get_library_name (gomx));
+                    continue;
+                }
+            }
+
+            GST_ELEMENT_ERROR (self, LIBRARY, INIT, (NULL),
+                               ("OpenMAX component didn't get to idle: 0x%x", gomx->omx_error));
+            gst_buffer_unref (buf);
+            return GST_FLOW_ERROR;
+        }
+    }
+
+    if (G_UNLIKELY (self->drop_late && too_late (self, buf)))
     {
         gst_buffer_unref (buf);
-        return self->last_pad_push_return;
+        return GST_FLOW_OK;
+    }
+
+    self->processed++;
+
+    if (self->in_queue_buffers || self->in_queue_bytes || self->in_queue_time ||
+        self->in_thread)
+    {
+        return queue_input (self, buf);
     }
+
+    return submit_input (self, buf);
 }
 
 static gboolean
@@ -622,26 +1829,58 @@ pad_event (GstPad *pad,
         case GST_EVENT_EOS:
             {
                 GOmxCore *gomx;
+                OMX_BUFFERHEADERTYPE *omx_buffer;
 
                 gomx = self->gomx;
 
+                /* Whatever is still queued goes first. */
+                drain_input (self);
+
+                if (!self->initialized || self->last_pad_push_return != GST_FLOW_OK)
+                {
+                    ret = gst_pad_push_event (self->srcpad, event);
+                    break;
+                }
+
                 /* send buffer with eos flag */
                 /** @todo move to util */
-                {
-                    OMX_BUFFERHEADERTYPE *omx_buffer;
 
+                /* What's packed goes along with it. */
+                if (self->pending)
+                {
+                    omx_buffer = self->pending;
+                    self->pending = NULL;
+                }
+                else
+                {
                     GST_LOG_OBJECT (self, "request buffer");
-                    omx_buffer = g_omx_port_request_buffer (self->in_port);
+                    if (gomx->timeout)
+                        omx_buffer = g_omx_port_request_buffer_timed (self->in_port, gomx->timeout);
+                    else
+                        omx_buffer = g_omx_port_request_buffer (self->in_port);
+                }
+
+                if (G_LIKELY (omx_buffer))
+                {
+                    /* Upstream goes on; the event follows the component's
+                     * last output, or gives up on it if the component
+                     * stalls. See forward_eos and stalled_cb. */
+                    drop_eos (self);
+                    GST_OBJECT_LOCK (self);
+                    self->eos_event = event;
+                    GST_OBJECT_UNLOCK (self);
 
                     omx_buffer->nFlags |= OMX_BUFFERFLAG_EOS;
 
                     GST_LOG_OBJECT (self, "release_buffer");
                     /* foo_buffer_untaint (omx_buffer); */
                     g_omx_port_release_buffer (self->in_port, omx_buffer);
+
+                    ret = TRUE;
+                    break;
                 }
 
-                /* Wait for the output port to get the EOS. */
-                g_omx_core_wait_for_done (gomx);
+                GST_WARNING_OBJECT (self, "no buffer to send eos");
             }
 
             ret = gst_pad_push_event (self->srcpad, event);
@@ -649,10 +1888,13 @@ pad_event (GstPad *pad,
 
         case GST_EVENT_FLUSH_START:
             /* unlock loops */
+            set_flushing (self, TRUE);
+            drop_eos (self);
+            flush_input (self, TRUE);
             g_omx_port_disable (self->in_port);
             g_omx_port_disable (self->out_port);
 
-            gst_pad_pause_task (self->srcpad);
+            stop_output (self, TRUE);
 
             /* flush all buffers */
             OMX_SendCommand (self->gomx->omx_handle, OMX_CommandFlush, OMX_ALL, NULL);
@@ -666,14 +1908,54 @@ pad_event (GstPad *pad,
 
             g_omx_sem_down (self->gomx->flush_sem);
 
-            gst_pad_start_task (self->srcpad, output_loop, self->srcpad);
+            flush_input (self, FALSE);
+
+            /* What was packed is flushed too; the buffer goes back empty. */
+            if (self->pending)
+            {
+                self->pending->nFilledLen = 0;
+                send_pending (self);
+            }
+
+            start_output (self);
 
             g_omx_port_enable (self->in_port);
             g_omx_port_enable (self->out_port);
 
+            /* With direct-push nobody else takes what the flush left. */
+            if (g_atomic_int_get (&self->direct_active))
+            {
+                GstFlowReturn flow = GST_FLOW_OK;
+
+                GST_PAD_STREAM_LOCK (self->srcpad);
+                output_queued (self, &flow);
+                GST_PAD_STREAM_UNLOCK (self->srcpad);
+            }
+
+            set_flushing (self, FALSE);
+            qos_reset (self);
+
             break;
 
         case GST_EVENT_NEWSEGMENT:
+            {
+                gboolean update;
+                gdouble rate;
+                GstFormat format;
+                gint64 start;
+                gint64 stop;
+                gint64 position;
+
+                gst_event_parse_new_segment (event, &update, &rate, &format,
+                                             &start, &stop, &position);
+
+                if (format == GST_FORMAT_TIME)
+                {
+                    gst_segment_set_newsegment (&self->segment, update, rate, format,
+                                                start, stop, position);
+                }
+            }
+
             ret = gst_pad_push_event (self->srcpad, event);
             break;
 
@@ -700,6 +1982,7 @@ activate_push (GstPad *pad,
     {
         GST_DEBUG_OBJECT (self, "activate");
         self->last_pad_push_return = GST_FLOW_OK;
+        set_flushing (self, FALSE);
 
         /* we do not start the task yet if the pad is not connected */
         if (gst_pad_is_linked (pad))
@@ -710,13 +1993,14 @@ activate_push (GstPad *pad,
                 g_omx_port_enable (self->in_port);
                 g_omx_port_enable (self->out_port);
 
-                result = gst_pad_start_task (pad, output_loop, pad);
+                result = start_output (self);
             }
         }
     }
     else
     {
         GST_DEBUG_OBJECT (self, "deactivate");
+        set_flushing (self, TRUE);
 
         if (self->initialized)
         {
@@ -729,7 +2013,7 @@ activate_push (GstPad *pad,
         }
 
         /* make sure streaming finishes */
-        result = gst_pad_stop_task (pad);
+        result = stop_output (self, FALSE);
     }
 
     gst_object_unref (self);
@@ -737,6 +2021,107 @@ activate_push (GstPad *pad,
     return result;
 }
 
+/** In low-latency mode, adds the component's own delay to what upstream reports. */
+static gboolean
+src_query (GstPad *pad,
+           GstQuery *query)
+{
+    GstOmxBaseFilter *self;
+    gboolean ret;
+
+    self = GST_OMX_BASE_FILTER (gst_pad_get_parent (pad));
+
+    switch (GST_QUERY_TYPE (query))
+    {
+        case GST_QUERY_LATENCY:
+            if (!self->low_latency)
+            {
+                ret = gst_pad_query_default (pad, query);
+                break;
+            }
+            {
+                gboolean live;
+                GstClockTime min;
+                GstClockTime max;
+                GstClockTime latency;
+
+                ret = gst_pad_peer_query (self->sinkpad, query);
+                if (!ret)
+                    break;
+
+                gst_query_parse_latency (query, &live, &min, &max);
+
+                g_mutex_lock (self->latency_mutex);
+                latency = self->latency;
+                self->reported_latency = latency;
+                g_mutex_unlock (self->latency_mutex);
+
+                GST_DEBUG_OBJECT (self, "latency: %" GST_TIME_FORMAT, GST_TIME_ARGS (latency));
+
+                min += latency;
+                if (GST_CLOCK_TIME_IS_VALID (max))
+                    max += latency;
+
+                gst_query_set_latency (query, live, min, max);
+                break;
+            }
+
+        default:
+            ret = gst_pad_query_default (pad, query);
+            break;
+    }
+
+    gst_object_unref (self);
+
+    return ret;
+}
+
+static gboolean
+src_event (GstPad *pad,
+           GstEvent *event)
+{
+    GstOmxBaseFilter *self;
+    gboolean ret;
+
+    self = GST_OMX_BASE_FILTER (gst_pad_get_parent (pad));
+
+    switch (GST_EVENT_TYPE (event))
+    {
+        case GST_EVENT_QOS:
+            {
+                gdouble proportion;
+                GstClockTimeDiff diff;
+                GstClockTime timestamp;
+
+                gst_event_parse_qos (event, &proportion, &diff, &timestamp);
+
+                GST_LOG_OBJECT (self, "qos: proportion=%g, diff=%" G_GINT64_FORMAT ", timestamp=%" GST_TIME_FORMAT,
+                                proportion, diff, GST_TIME_ARGS (timestamp));
+
+                /* Anything ending before this will be late downstream. */
+                GST_OBJECT_LOCK (self);
+                if (!GST_CLOCK_TIME_IS_VALID (timestamp))
+                    self->earliest_time = GST_CLOCK_TIME_NONE;
+                else if (diff < 0 && (GstClockTime) -diff > timestamp)
+                    self->earliest_time = 0;
+                else
+                    self->earliest_time = timestamp + diff;
+                GST_OBJECT_UNLOCK (self);
+
+                ret = gst_pad_push_event (self->sinkpad, event);
+                break;
+            }
+
+        default:
+            ret = gst_pad_event_default (pad, event);
+            break;
+    }
+
+    gst_object_unref (self);
+
+    return ret;
+}
+
 static void
 type_instance_init (GTypeInstance *instance,
                     gpointer g_class)
@@ -751,12 +2136,26 @@ type_instance_init (GTypeInstance *instance,
     GST_LOG_OBJECT (self, "begin");
 
     self->use_timestamps = TRUE;
+    self->out_fd = -1;
+
+    self->backpressure_mutex = g_mutex_new ();
+    self->backpressure_cond = g_cond_new ();
+
+    self->in_mutex = g_mutex_new ();
+    self->in_cond = g_cond_new ();
+    self->in_queue = g_queue_new ();
+
+    self->latency_mutex = g_mutex_new ();
+    latency_reset (self);
+
+    qos_reset (self);
 
     /* GOmx */
     {
         GOmxCore *gomx;
         self->gomx = gomx = g_omx_core_new ();
         gomx->client_data = self;
+        gomx->stalled_cb = stalled_cb;
     }
 
     self->sinkpad =
@@ -769,6 +2168,8 @@ type_instance_init (GTypeInstance *instance,
         gst_pad_new_from_template (gst_element_class_get_pad_template (element_class, "src"), "src");
 
     gst_pad_set_activatepush_function (self->srcpad, activate_push);
+    gst_pad_set_query_function (self->srcpad, src_query);
+    gst_pad_set_event_function (self->srcpad, src_event);
 
     gst_pad_use_fixed_caps (self->srcpad);
 
@@ -34,6 +34,9 @@ typedef struct GstOmxBaseFilter GstOmxBaseFilter;
 typedef struct GstOmxBaseFilterClass GstOmxBaseFilterClass;
 typedef void (*GstOmxBaseFilterCb) (GstOmxBaseFilter *self);
 
+#define GST_OMX_BASE_FILTER_LATENCY_SAMPLES 16
+#define GST_OMX_BASE_FILTER_LATENCY_WINDOW 32
+
 #include <gstomx_util.h>
 #include <async_queue.h>
 
@@ -50,12 +53,71 @@ struct GstOmxBaseFilter
 
     char *omx_component;
     char *omx_library;
+    char *omx_role;
     gboolean use_timestamps; /** @todo remove; timestamps should always be used */
     gboolean initialized;
 
     GstOmxBaseFilterCb omx_setup;
     GstFlowReturn last_pad_push_return;
     GstBuffer *codec_data;
+
+    OMX_BUFFERHEADERTYPE **out_batch; /**< Scratch space for output_loop. */
+    gboolean shared_output;
+    gint out_fd; /**< Watched by the shared dispatcher; -1 when the task is used. */
+    gboolean direct_push;
+    volatile gint direct_active; /**< Output goes out from the callbacks; see output_direct. */
+    GThread *direct_thread; /**< Pushing from output_direct. */
+
+    guint out_low_watermark;
+    guint out_high_watermark;
+    GMutex *backpressure_mutex;
+    GCond *backpressure_cond;
+    gboolean backpressure; /**< Output is above its high watermark. */
+    gboolean flushing;
+
+    GOmxAllocation in_allocation;
+    GOmxAllocation out_allocation;
+    GOmxBufferCount in_count;
+    GOmxBufferCount out_count;
+    gboolean zero_copy_input;
+
+    guint aggregate_bytes;
+    GstClockTime aggregate_time;
+    OMX_BUFFERHEADERTYPE *pending; /**< Input being packed; see aggregate. */
+    GstClockTime pending_start;
+    GstClockTime pending_end;
+
+    guint in_queue_buffers;
+    guint in_queue_bytes;
+    GstClockTime in_queue_time; /**< Limits of the input queue; all 0 means none. */
+    GThread *in_thread; /**< Submits the queued input; see queue_input. */
+    GMutex *in_mutex;
+    GCond *in_cond;
+    GQueue *in_queue;
+    guint in_queued_bytes;
+    gboolean in_busy; /**< The input thread is submitting a buffer. */
+    gboolean in_flushing;
+    gboolean in_quit;
+    GstFlowReturn in_return;
+
+    gboolean low_latency;
+    GMutex *latency_mutex;
+    OMX_TICKS latency_timestamps[GST_OMX_BASE_FILTER_LATENCY_SAMPLES]; /**< Of the latest input; see latency_in. */
+    GstClockTime latency_times[GST_OMX_BASE_FILTER_LATENCY_SAMPLES]; /**< When each of those went in. */
+    guint latency_next;
+    GstClockTime latency_delays[GST_OMX_BASE_FILTER_LATENCY_WINDOW]; /**< The latest ones measured. */
+    guint latency_delay_next;
+    GstClockTime latency; /**< Longest of latency_delays. */
+    GstClockTime reported_latency; /**< What the pipeline was last told. */
+
+    GstEvent *eos_event; /**< Held back until the component drains; object lock. */
+
+    gboolean drop_late; /**< Skip input QoS says is late; see too_late. */
+    GstSegment segment;
+    GstClockTime earliest_time; /**< From downstream's QoS, in running time; object lock. */
+    gboolean qos_resync; /**< Skipping input until the next keyframe. */
+    guint processed;
+    guint dropped;
 };
 
 struct GstOmxBaseFilterClass
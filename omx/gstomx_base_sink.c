@@ -21,16 +21,22 @@
 
 #include "gstomx_base_sink.h"
 #include "gstomx.h"
+#include "gstomx_stats.h"
 
 #include <string.h> /* For memcpy */
 
-static gboolean share_input_buffer = FALSE;
-
 enum
 {
     ARG_0,
     ARG_COMPONENT_NAME,
-    ARG_LIBRARY_NAME
+    ARG_LIBRARY_NAME,
+    ARG_COMPONENT_ROLE,
+    ARG_SPIN_COUNT,
+    ARG_PREFAULT_BUFFERS,
+    ARG_ALLOCATION,
+    ARG_INPUT_BUFFERS,
+    ARG_ZERO_COPY_INPUT,
+    ARG_STATS
 };
 
 static GstElementClass *parent_class = NULL;
@@ -52,7 +58,21 @@ setup_ports (GstOmxBaseSink *self)
 
     param->nPortIndex = 0;
     OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
-    self->in_port = g_omx_core_setup_port (core, param);
+    {
+        guint count;
+        gboolean grow;
+
+        count = self->in_count.count;
+        grow = self->in_count.grow;
+
+        self->in_port = g_omx_core_setup_port_count (core, param, &self->in_count);
+
+        if (grow)
+            GST_INFO_OBJECT (self, "input port starved, buffers: %u -> %u", count, self->in_port->num_buffers);
+        else
+            GST_DEBUG_OBJECT (self, "input buffers: %u", self->in_port->num_buffers);
+    }
+    self->in_port->allocation = self->allocation;
 
     free (param);
 }
@@ -66,10 +86,12 @@ start (GstBaseSink *gst_base)
 
     GST_LOG_OBJECT (self, "begin");
 
-    g_omx_core_init (self->gomx, self->omx_library, self->omx_component);
+    g_omx_core_init_role (self->gomx, self->omx_library, self->omx_component, self->omx_role);
     if (self->gomx->omx_error)
         return GST_STATE_CHANGE_FAILURE;
 
+    GST_INFO_OBJECT (self, "using %s", g_omx_core_get_library_name (self->gomx));
+
     GST_LOG_OBJECT (self, "end");
 
     return TRUE;
@@ -106,6 +128,7 @@ dispose (GObject *obj)
 
     g_free (self->omx_component);
     g_free (self->omx_library);
+    g_free (self->omx_role);
 
     G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
@@ -134,6 +157,15 @@ render (GstBaseSink *gst_base,
 
         setup_ports (self);
         g_omx_core_prepare (self->gomx);
+
+        /* Out of resources; another library may have some. */
+        while (gomx->omx_error == OMX_ErrorInsufficientResources &&
+               g_omx_core_failover (gomx))
+        {
+            GST_WARNING_OBJECT (self, "falling back to %s", g_omx_core_get_library_name (gomx));
+            setup_ports (self);
+            g_omx_core_prepare (gomx);
+        }
     }
 
     in_port = self->in_port;
@@ -166,30 +198,14 @@ render (GstBaseSink *gst_base,
                                   omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nFlags,
                                   omx_buffer->nOffset, omx_buffer->nTimeStamp);
 
-                if (omx_buffer->nOffset == 0 &&
-                    share_input_buffer)
+                /* The component reads upstream's data itself if it can. */
+                if (buffer_offset == 0 && self->zero_copy_input &&
+                    g_omx_port_borrow_data (in_port, omx_buffer,
+                                            GST_BUFFER_DATA (buf), GST_BUFFER_SIZE (buf),
+                                            buf, (GDestroyNotify) gst_buffer_unref))
                 {
-                    {
-                        GstBuffer *old_buf;
-                        old_buf = omx_buffer->pAppPrivate;
-
-                        if (old_buf)
-                        {
-                            gst_buffer_unref (old_buf);
-                        }
-                        else if (omx_buffer->pBuffer)
-                        {
-                            g_free (omx_buffer->pBuffer);
-                        }
-                    }
-
-                    /* We are going to use this. */
+                    /* Until the component is done with it. */
                     gst_buffer_ref (buf);
-
-                    omx_buffer->pBuffer = GST_BUFFER_DATA (buf);
-                    omx_buffer->nAllocLen = GST_BUFFER_SIZE (buf);
-                    omx_buffer->nFilledLen = GST_BUFFER_SIZE (buf);
-                    omx_buffer->pAppPrivate = buf;
                 }
                 else
                 {
@@ -198,10 +214,10 @@ render (GstBaseSink *gst_base,
                     memcpy (omx_buffer->pBuffer + omx_buffer->nOffset, GST_BUFFER_DATA (buf) + buffer_offset, omx_buffer->nFilledLen);
                 }
 
+                buffer_offset += omx_buffer->nFilledLen;
+
                 GST_LOG_OBJECT (self, "release_buffer");
                 g_omx_port_release_buffer (in_port, omx_buffer);
-
-                buffer_offset += omx_buffer->nFilledLen;
             }
             else
             {
@@ -289,6 +305,25 @@ set_property (GObject *obj,
             }
             self->omx_library = g_value_dup_string (value);
             break;
+        case ARG_COMPONENT_ROLE:
+            g_free (self->omx_role);
+            self->omx_role = g_value_dup_string (value);
+            break;
+        case ARG_SPIN_COUNT:
+            g_omx_core_set_spin (self->gomx, g_value_get_uint (value));
+            break;
+        case ARG_INPUT_BUFFERS:
+            self->in_count.wanted = g_value_get_int (value);
+            break;
+        case ARG_ALLOCATION:
+            self->allocation = g_value_get_enum (value);
+            break;
+        case ARG_PREFAULT_BUFFERS:
+            self->gomx->prefault = g_value_get_boolean (value);
+            break;
+        case ARG_ZERO_COPY_INPUT:
+            self->zero_copy_input = g_value_get_boolean (value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -313,6 +348,27 @@ get_property (GObject *obj,
         case ARG_LIBRARY_NAME:
             g_value_set_string (value, self->omx_library);
             break;
+        case ARG_COMPONENT_ROLE:
+            g_value_set_string (value, self->omx_role);
+            break;
+        case ARG_SPIN_COUNT:
+            g_value_set_uint (value, self->gomx->spin);
+            break;
+        case ARG_INPUT_BUFFERS:
+            g_value_set_int (value, self->in_count.wanted);
+            break;
+        case ARG_ALLOCATION:
+            g_value_set_enum (value, self->allocation);
+            break;
+        case ARG_PREFAULT_BUFFERS:
+            g_value_set_boolean (value, self->gomx->prefault);
+            break;
+        case ARG_ZERO_COPY_INPUT:
+            g_value_set_boolean (value, self->zero_copy_input);
+            break;
+        case ARG_STATS:
+            g_value_take_boxed (value, gstomx_get_stats (self->gomx));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -353,8 +409,43 @@ type_class_init (gpointer g_class,
 
         g_object_class_install_property (gobject_class, ARG_LIBRARY_NAME,
                                          g_param_spec_string ("library-name", "Library name",
-                                                              "Name of the OpenMAX IL implementation library to use",
+                                                              "OpenMAX IL implementation libraries to try, separated by ':'; \"auto\" tries the known ones",
                                                               NULL, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_COMPONENT_ROLE,
+                                         g_param_spec_string ("component-role", "Component role",
+                                                              "Standard role the component should take (NULL = its default)",
+                                                              NULL, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_SPIN_COUNT,
+                                         g_param_spec_uint ("spin-count", "Spin count",
+                                                            "Maximum iterations to busy-wait for the component before sleeping (0 = don't spin)",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_PREFAULT_BUFFERS,
+                                         g_param_spec_boolean ("prefault-buffers", "Prefault buffers",
+                                                               "Touch the buffers' memory when allocating it, so the first frames don't page fault",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_ALLOCATION,
+                                         g_param_spec_enum ("allocation", "Allocation",
+                                                            "Who allocates the buffers",
+                                                            GST_OMX_TYPE_ALLOCATION, GOMX_ALLOCATION_USE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_INPUT_BUFFERS,
+                                         g_param_spec_int ("input-buffers", "Input buffers",
+                                                           "Buffers on the input port (0 = what the component suggests, -1 = tune automatically)",
+                                                           -1, G_MAXINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_ZERO_COPY_INPUT,
+                                         g_param_spec_boolean ("zero-copy-input", "Zero-copy input",
+                                                               "Hand upstream's data to the component instead of copying it, when it fits the input port",
+                                                               FALSE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_STATS,
+                                         g_param_spec_boxed ("stats", "Statistics",
+                                                             "Port queue and semaphore statistics",
+                                                             GST_TYPE_STRUCTURE, G_PARAM_READABLE));
     }
 }
 
@@ -48,6 +48,10 @@ struct GstOmxBaseSink
 
     char *omx_component;
     char *omx_library;
+    char *omx_role;
+    GOmxAllocation allocation;
+    GOmxBufferCount in_count;
+    gboolean zero_copy_input;
 };
 
 struct GstOmxBaseSinkClass
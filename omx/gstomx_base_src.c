@@ -21,6 +21,7 @@
 
 #include "gstomx_base_src.h"
 #include "gstomx.h"
+#include "gstomx_stats.h"
 
 #include <string.h> /* For memcpy */
 #include <stdbool.h>
@@ -29,7 +30,12 @@ enum
 {
     ARG_0,
     ARG_COMPONENT_NAME,
-    ARG_LIBRARY_NAME
+    ARG_LIBRARY_NAME,
+    ARG_COMPONENT_ROLE,
+    ARG_SPIN_COUNT,
+    ARG_ALLOCATION,
+    ARG_OUTPUT_BUFFERS,
+    ARG_STATS
 };
 
 static GstElementClass *parent_class = NULL;
@@ -51,10 +57,28 @@ setup_ports (GstOmxBaseSrc *self)
 
     param->nPortIndex = 0;
     OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
-    self->out_port = g_omx_core_setup_port (core, param);
+    {
+        guint count;
+        gboolean grow;
+
+        count = self->out_count.count;
+        grow = self->out_count.grow;
+
+        self->out_port = g_omx_core_setup_port_count (core, param, &self->out_count);
+
+        if (grow)
+            GST_INFO_OBJECT (self, "output port starved, buffers: %u -> %u", count, self->out_port->num_buffers);
+        else
+            GST_DEBUG_OBJECT (self, "output buffers: %u", self->out_port->num_buffers);
+    }
+    self->out_port->allocation = self->allocation;
 
     free (param);
 
+    g_free (self->out_batch);
+    self->out_batch = g_new (OMX_BUFFERHEADERTYPE *, self->out_port->num_buffers);
+    self->batch_count = self->batch_index = 0;
+
     if (self->setup_ports)
     {
         self->setup_ports (self);
@@ -70,10 +94,12 @@ start (GstBaseSrc *gst_base)
 
     GST_LOG_OBJECT (self, "begin");
 
-    g_omx_core_init (self->gomx, self->omx_library, self->omx_component);
+    g_omx_core_init_role (self->gomx, self->omx_library, self->omx_component, self->omx_role);
     if (self->gomx->omx_error)
         return GST_STATE_CHANGE_FAILURE;
 
+    GST_INFO_OBJECT (self, "using %s", g_omx_core_get_library_name (self->gomx));
+
     GST_LOG_OBJECT (self, "end");
 
     return true;
@@ -108,12 +134,36 @@ dispose (GObject *obj)
 
     g_omx_core_free (self->gomx);
 
+    g_free (self->out_batch);
+
     g_free (self->omx_component);
     g_free (self->omx_library);
+    g_free (self->omx_role);
 
     G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
 
+/**
+ * Every wakeup takes all the buffers the component has filled; the
+ * following calls are served from that batch without touching the queue.
+ */
+static OMX_BUFFERHEADERTYPE *
+request_buffer (GstOmxBaseSrc *self)
+{
+    if (self->batch_index == self->batch_count)
+    {
+        self->batch_index = 0;
+        self->batch_count = g_omx_port_request_buffers (self->out_port,
+                                                        self->out_batch,
+                                                        self->out_port->num_buffers);
+
+        if (self->batch_count == 0)
+            return NULL;
+    }
+
+    return self->out_batch[self->batch_index++];
+}
+
 static GstFlowReturn
 create (GstBaseSrc *gst_base,
         guint64 offset,
@@ -139,6 +189,15 @@ create (GstBaseSrc *gst_base,
 
         setup_ports (self);
         g_omx_core_prepare (self->gomx);
+
+        /* Out of resources; another library may have some. */
+        while (gomx->omx_error == OMX_ErrorInsufficientResources &&
+               g_omx_core_failover (gomx))
+        {
+            GST_WARNING_OBJECT (self, "falling back to %s", g_omx_core_get_library_name (gomx));
+            setup_ports (self);
+            g_omx_core_prepare (gomx);
+        }
     }
 
     out_port = self->out_port;
@@ -171,7 +230,7 @@ create (GstBaseSrc *gst_base,
             OMX_BUFFERHEADERTYPE *omx_buffer;
 
             GST_LOG_OBJECT (self, "request_buffer");
-            omx_buffer = g_omx_port_request_buffer (out_port);
+            omx_buffer = request_buffer (self);
 
             if (omx_buffer)
             {
@@ -241,7 +300,8 @@ create (GstBaseSrc *gst_base,
 
                         if (buf)
                         {
-                            GST_WARNING_OBJECT (self, "couldn't zero-copy");
+                            if (!out_port->allocated)
+                                GST_WARNING_OBJECT (self, "couldn't zero-copy");
                             memcpy (GST_BUFFER_DATA (buf), omx_buffer->pBuffer + omx_buffer->nOffset, omx_buffer->nFilledLen);
 #if 0
                             if (self->use_timestamps)
@@ -251,8 +311,7 @@ create (GstBaseSrc *gst_base,
 #endif
 
                             omx_buffer->nFilledLen = 0;
-                            g_free (omx_buffer->pBuffer);
-                            omx_buffer->pBuffer = NULL;
+                            g_omx_port_free_buffer_data (out_port, omx_buffer);
 
                             *ret_buf = buf;
                         }
@@ -378,6 +437,19 @@ set_property (GObject *obj,
             }
             self->omx_library = g_value_dup_string (value);
             break;
+        case ARG_COMPONENT_ROLE:
+            g_free (self->omx_role);
+            self->omx_role = g_value_dup_string (value);
+            break;
+        case ARG_SPIN_COUNT:
+            g_omx_core_set_spin (self->gomx, g_value_get_uint (value));
+            break;
+        case ARG_OUTPUT_BUFFERS:
+            self->out_count.wanted = g_value_get_int (value);
+            break;
+        case ARG_ALLOCATION:
+            self->allocation = g_value_get_enum (value);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -402,6 +474,21 @@ get_property (GObject *obj,
         case ARG_LIBRARY_NAME:
             g_value_set_string (value, self->omx_library);
             break;
+        case ARG_COMPONENT_ROLE:
+            g_value_set_string (value, self->omx_role);
+            break;
+        case ARG_SPIN_COUNT:
+            g_value_set_uint (value, self->gomx->spin);
+            break;
+        case ARG_OUTPUT_BUFFERS:
+            g_value_set_int (value, self->out_count.wanted);
+            break;
+        case ARG_ALLOCATION:
+            g_value_set_enum (value, self->allocation);
+            break;
+        case ARG_STATS:
+            g_value_take_boxed (value, gstomx_get_stats (self->gomx));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
             break;
@@ -441,8 +528,33 @@ type_class_init (gpointer g_class,
 
         g_object_class_install_property (gobject_class, ARG_LIBRARY_NAME,
                                          g_param_spec_string ("library-name", "Library name",
-                                                              "Name of the OpenMAX IL implementation library to use",
+                                                              "OpenMAX IL implementation libraries to try, separated by ':'; \"auto\" tries the known ones",
                                                               NULL, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_COMPONENT_ROLE,
+                                         g_param_spec_string ("component-role", "Component role",
+                                                              "Standard role the component should take (NULL = its default)",
+                                                              NULL, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_SPIN_COUNT,
+                                         g_param_spec_uint ("spin-count", "Spin count",
+                                                            "Maximum iterations to busy-wait for the component before sleeping (0 = don't spin)",
+                                                            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_ALLOCATION,
+                                         g_param_spec_enum ("allocation", "Allocation",
+                                                            "Who allocates the buffers",
+                                                            GST_OMX_TYPE_ALLOCATION, GOMX_ALLOCATION_USE, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_OUTPUT_BUFFERS,
+                                         g_param_spec_int ("output-buffers", "Output buffers",
+                                                           "Buffers on the output port (0 = what the component suggests, -1 = tune automatically)",
+                                                           -1, G_MAXINT, 0, G_PARAM_READWRITE));
+
+        g_object_class_install_property (gobject_class, ARG_STATS,
+                                         g_param_spec_boxed ("stats", "Statistics",
+                                                             "Port queue and semaphore statistics",
+                                                             GST_TYPE_STRUCTURE, G_PARAM_READABLE));
     }
 }
 
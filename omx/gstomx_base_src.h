@@ -46,7 +46,14 @@ struct GstOmxBaseSrc
 
     char *omx_component;
     char *omx_library;
+    char *omx_role;
+    GOmxAllocation allocation;
+    GOmxBufferCount out_count;
     GstOmxBaseSrcCb setup_ports;
+
+    OMX_BUFFERHEADERTYPE **out_batch;
+    guint batch_count;
+    guint batch_index;
 };
 
 struct GstOmxBaseSrcClass
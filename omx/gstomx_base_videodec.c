@@ -303,6 +303,7 @@ type_instance_init (GTypeInstance *instance,
     omx_base = GST_OMX_BASE_FILTER (instance);
 
     omx_base->omx_setup = omx_setup;
+    omx_base->drop_late = TRUE;
 
     omx_base->gomx->settings_changed_cb = settings_changed_cb;
 
@@ -23,8 +23,6 @@
 #include "gstomx_base_filter.h"
 #include "gstomx.h"
 
-#define OMX_COMPONENT_NAME "OMX.st.dummy"
-
 static GstOmxBaseFilterClass *parent_class = NULL;
 
 static GstCaps *
@@ -104,8 +102,6 @@ type_instance_init (GTypeInstance *instance,
     omx_base = GST_OMX_BASE_FILTER (instance);
 
     GST_DEBUG_OBJECT (omx_base, "start");
-
-    omx_base->omx_component = g_strdup (OMX_COMPONENT_NAME);
 }
 
 GType
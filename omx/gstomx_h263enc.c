@@ -22,8 +22,6 @@
 #include "gstomx_h263enc.h"
 #include "gstomx.h"
 
-#define OMX_COMPONENT_NAME "OMX.st.video_encoder.h263"
-
 static GstOmxBaseFilterClass *parent_class = NULL;
 
 static GstCaps *
@@ -135,7 +133,6 @@ type_instance_init (GTypeInstance *instance,
     omx_base_filter = GST_OMX_BASE_FILTER (instance);
     omx_base = GST_OMX_BASE_VIDEOENC (instance);
 
-    omx_base_filter->omx_component = g_strdup (OMX_COMPONENT_NAME);
     omx_base->compression_format = OMX_VIDEO_CodingH263;
 
     omx_base_filter->gomx->settings_changed_cb = settings_changed_cb;
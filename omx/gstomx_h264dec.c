@@ -22,8 +22,6 @@
 #include "gstomx_h264dec.h"
 #include "gstomx.h"
 
-#define OMX_COMPONENT_NAME "OMX.st.video_decoder.avc"
-
 static GstOmxBaseVideoDecClass *parent_class = NULL;
 
 static GstCaps *
@@ -85,13 +83,10 @@ static void
 type_instance_init (GTypeInstance *instance,
                     gpointer g_class)
 {
-    GstOmxBaseFilter *omx_base_filter;
     GstOmxBaseVideoDec *omx_base;
 
-    omx_base_filter = GST_OMX_BASE_FILTER (instance);
     omx_base = GST_OMX_BASE_VIDEODEC (instance);
 
-    omx_base_filter->omx_component = g_strdup (OMX_COMPONENT_NAME);
     omx_base->compression_format = OMX_VIDEO_CodingAVC;
 }
 
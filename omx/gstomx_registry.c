@@ -0,0 +1,729 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE /* dladdr */
+
+#include "gstomx_registry.h"
+#include "gstomx_util.h"
+
+#include <glib/gstdio.h>
+#include <dlfcn.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define LIBRARY_GROUP "library"
+#define MAX_PORTS 16
+#define MAX_FORMATS 32
+
+struct GOmxRegistry
+{
+    GKeyFile *key_file; /**< A group per component, plus LIBRARY_GROUP. */
+};
+
+/*
+ * Registration files
+ */
+
+/**
+ * Files the IL cores register their components in; installing a component
+ * changes what a library provides without touching the library itself.
+ * Only Bellagio's are known. Free with g_strfreev().
+ */
+static gchar **
+registration_files (void)
+{
+    const gchar *env;
+    gchar **files;
+
+    env = g_getenv ("OMX_BELLAGIO_REGISTRY");
+    if (env)
+    {
+        files = g_new0 (gchar *, 2);
+        files[0] = g_strdup (env);
+        return files;
+    }
+
+    files = g_new0 (gchar *, 3);
+    files[0] = g_build_filename (g_get_user_data_dir (), "libomxil-bellagio", "registry", NULL);
+    files[1] = g_build_filename (g_get_home_dir (), ".omxregister", NULL);
+
+    return files;
+}
+
+/** Of the registration files, in the same order; 0 for a missing one. */
+static gchar **
+registration_mtimes (gchar **files)
+{
+    gchar **mtimes;
+    guint i;
+
+    mtimes = g_new0 (gchar *, g_strv_length (files) + 1);
+
+    for (i = 0; files[i]; i++)
+    {
+        struct stat st;
+
+        if (g_stat (files[i], &st) != 0)
+            st.st_mtime = 0;
+
+        mtimes[i] = g_strdup_printf ("%lu", (gulong) st.st_mtime);
+    }
+
+    return mtimes;
+}
+
+static gboolean
+strv_equal (gchar **a,
+            gchar **b)
+{
+    guint i;
+
+    if (!a || !b)
+        return FALSE;
+
+    for (i = 0; a[i] && b[i]; i++)
+    {
+        if (strcmp (a[i], b[i]) != 0)
+            return FALSE;
+    }
+
+    return !a[i] && !b[i];
+}
+
+/*
+ * Probing
+ */
+
+static OMX_ERRORTYPE
+probe_event (OMX_HANDLETYPE omx_handle,
+             OMX_PTR app_data,
+             OMX_EVENTTYPE event,
+             OMX_U32 data1,
+             OMX_U32 data2,
+             OMX_PTR event_data)
+{
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+probe_buffer_done (OMX_HANDLETYPE omx_handle,
+                   OMX_PTR app_data,
+                   OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    return OMX_ErrorNone;
+}
+
+static OMX_CALLBACKTYPE probe_callbacks = { probe_event, probe_buffer_done, probe_buffer_done };
+
+static void
+init_param (gpointer param,
+            OMX_U32 size)
+{
+    OMX_PORT_PARAM_TYPE *header;
+
+    /* They all start the same way. */
+    header = param;
+
+    memset (param, 0, size);
+    header->nSize = size;
+    header->nVersion.s.nVersionMajor = 1;
+    header->nVersion.s.nVersionMinor = 1;
+}
+
+static const gchar *
+domain_name (OMX_PORTDOMAINTYPE domain)
+{
+    switch (domain)
+    {
+        case OMX_PortDomainAudio:
+            return "audio";
+        case OMX_PortDomainVideo:
+            return "video";
+        case OMX_PortDomainImage:
+            return "image";
+        default:
+            return "other";
+    }
+}
+
+static void
+set_port_key (GKeyFile *key_file,
+              const gchar *group,
+              OMX_U32 index,
+              const gchar *name,
+              const gchar *value)
+{
+    gchar *key;
+    key = g_strdup_printf ("port%lu-%s", (gulong) index, name);
+    g_key_file_set_string (key_file, group, key, value);
+    g_free (key);
+}
+
+static void
+set_port_list (GKeyFile *key_file,
+               const gchar *group,
+               OMX_U32 index,
+               const gchar *name,
+               gint *list,
+               gsize length)
+{
+    gchar *key;
+    key = g_strdup_printf ("port%lu-%s", (gulong) index, name);
+    g_key_file_set_integer_list (key_file, group, key, list, length);
+    g_free (key);
+}
+
+/*
+ * Components can't be trusted to fail once the list of formats is over;
+ * some keep returning the last one. Either way ends the enumeration.
+ */
+
+static gsize
+probe_audio_formats (OMX_HANDLETYPE omx_handle,
+                     OMX_U32 index,
+                     gint *formats)
+{
+    gsize count;
+
+    for (count = 0; count < MAX_FORMATS; count++)
+    {
+        OMX_AUDIO_PARAM_PORTFORMATTYPE param;
+
+        init_param (&param, sizeof (param));
+        param.nPortIndex = index;
+        param.nIndex = count;
+
+        if (OMX_GetParameter (omx_handle, OMX_IndexParamAudioPortFormat, &param) != OMX_ErrorNone)
+            break;
+
+        if (param.eEncoding == OMX_AUDIO_CodingUnused ||
+            (count && formats[count - 1] == param.eEncoding))
+            break;
+
+        formats[count] = param.eEncoding;
+    }
+
+    return count;
+}
+
+static gsize
+probe_video_formats (OMX_HANDLETYPE omx_handle,
+                     OMX_U32 index,
+                     gint *formats,
+                     gint *colors)
+{
+    gsize count;
+
+    for (count = 0; count < MAX_FORMATS; count++)
+    {
+        OMX_VIDEO_PARAM_PORTFORMATTYPE param;
+
+        init_param (&param, sizeof (param));
+        param.nPortIndex = index;
+        param.nIndex = count;
+
+        if (OMX_GetParameter (omx_handle, OMX_IndexParamVideoPortFormat, &param) != OMX_ErrorNone)
+            break;
+
+        if (count &&
+            formats[count - 1] == param.eCompressionFormat &&
+            colors[count - 1] == param.eColorFormat)
+            break;
+
+        formats[count] = param.eCompressionFormat;
+        colors[count] = param.eColorFormat;
+    }
+
+    return count;
+}
+
+static gsize
+probe_image_formats (OMX_HANDLETYPE omx_handle,
+                     OMX_U32 index,
+                     gint *formats,
+                     gint *colors)
+{
+    gsize count;
+
+    for (count = 0; count < MAX_FORMATS; count++)
+    {
+        OMX_IMAGE_PARAM_PORTFORMATTYPE param;
+
+        init_param (&param, sizeof (param));
+        param.nPortIndex = index;
+        param.nIndex = count;
+
+        if (OMX_GetParameter (omx_handle, OMX_IndexParamImagePortFormat, &param) != OMX_ErrorNone)
+            break;
+
+        if (count &&
+            formats[count - 1] == param.eCompressionFormat &&
+            colors[count - 1] == param.eColorFormat)
+            break;
+
+        formats[count] = param.eCompressionFormat;
+        colors[count] = param.eColorFormat;
+    }
+
+    return count;
+}
+
+static gboolean
+probe_port (GKeyFile *key_file,
+            const gchar *group,
+            OMX_HANDLETYPE omx_handle,
+            OMX_U32 index)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+    gint formats[MAX_FORMATS];
+    gint colors[MAX_FORMATS];
+    gsize count = 0;
+    gchar *value;
+
+    init_param (&param, sizeof (param));
+    param.nPortIndex = index;
+
+    if (OMX_GetParameter (omx_handle, OMX_IndexParamPortDefinition, &param) != OMX_ErrorNone)
+        return FALSE;
+
+    set_port_key (key_file, group, index, "direction",
+                  param.eDir == OMX_DirInput ? "input" : "output");
+    set_port_key (key_file, group, index, "domain", domain_name (param.eDomain));
+
+    value = g_strdup_printf ("%lu", (gulong) param.nBufferCountMin);
+    set_port_key (key_file, group, index, "buffer-count", value);
+    g_free (value);
+
+    value = g_strdup_printf ("%lu", (gulong) param.nBufferSize);
+    set_port_key (key_file, group, index, "buffer-size", value);
+    g_free (value);
+
+    switch (param.eDomain)
+    {
+        case OMX_PortDomainAudio:
+            count = probe_audio_formats (omx_handle, index, formats);
+            break;
+        case OMX_PortDomainVideo:
+            count = probe_video_formats (omx_handle, index, formats, colors);
+            break;
+        case OMX_PortDomainImage:
+            count = probe_image_formats (omx_handle, index, formats, colors);
+            break;
+        default:
+            break;
+    }
+
+    if (count)
+    {
+        set_port_list (key_file, group, index, "formats", formats, count);
+        if (param.eDomain != OMX_PortDomainAudio)
+            set_port_list (key_file, group, index, "color-formats", colors, count);
+    }
+
+    return TRUE;
+}
+
+static void
+probe_roles (GKeyFile *key_file,
+             GOmxImp *imp,
+             gchar *name)
+{
+    OMX_U32 count = 0;
+    OMX_U8 **roles;
+    OMX_U32 i;
+
+    if (!imp->sym_table.get_roles_of_component)
+        return;
+
+    if (imp->sym_table.get_roles_of_component (name, &count, NULL) != OMX_ErrorNone || !count)
+        return;
+
+    roles = g_new0 (OMX_U8 *, count);
+    for (i = 0; i < count; i++)
+        roles[i] = g_malloc0 (OMX_MAX_STRINGNAME_SIZE);
+
+    if (imp->sym_table.get_roles_of_component (name, &count, roles) == OMX_ErrorNone)
+        g_key_file_set_string_list (key_file, name, "roles", (const gchar * const *) roles, count);
+
+    for (i = 0; i < count; i++)
+        g_free (roles[i]);
+    g_free (roles);
+}
+
+static void
+probe_component (GKeyFile *key_file,
+                 GOmxImp *imp,
+                 gchar *name)
+{
+    OMX_HANDLETYPE omx_handle;
+    GArray *ports;
+
+    probe_roles (key_file, imp, name);
+
+    ports = g_array_new (FALSE, FALSE, sizeof (gint));
+
+    if (imp->sym_table.get_handle (&omx_handle, name, NULL, &probe_callbacks) == OMX_ErrorNone)
+    {
+        static const OMX_INDEXTYPE domains[] = { OMX_IndexParamAudioInit,
+                                                 OMX_IndexParamVideoInit,
+                                                 OMX_IndexParamImageInit,
+                                                 OMX_IndexParamOtherInit };
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (domains); i++)
+        {
+            OMX_PORT_PARAM_TYPE param;
+            OMX_U32 index;
+
+            init_param (&param, sizeof (param));
+
+            if (OMX_GetParameter (omx_handle, domains[i], &param) != OMX_ErrorNone)
+                continue;
+
+            for (index = param.nStartPortNumber;
+                 index < param.nStartPortNumber + MIN (param.nPorts, MAX_PORTS);
+                 index++)
+            {
+                if (probe_port (key_file, name, omx_handle, index))
+                {
+                    gint value = index;
+                    g_array_append_val (ports, value);
+                }
+            }
+        }
+
+        imp->sym_table.free_handle (omx_handle);
+    }
+
+    /* Also makes sure the group exists. */
+    g_key_file_set_integer_list (key_file, name, "ports", (gint *) ports->data, ports->len);
+
+    g_array_free (ports, TRUE);
+}
+
+/** Where the library was loaded from; NULL if that can't be found out. */
+static gchar *
+library_path (GOmxImp *imp,
+              const gchar *library_name)
+{
+    Dl_info info;
+
+    if (g_path_is_absolute (library_name))
+        return g_strdup (library_name);
+
+    if (imp->sym_table.init &&
+        dladdr ((void *) imp->sym_table.init, &info) &&
+        info.dli_fname)
+        return g_strdup (info.dli_fname);
+
+    return NULL;
+}
+
+static GKeyFile *
+probe (const gchar *library_name)
+{
+    GOmxImp *imp;
+    GKeyFile *key_file;
+    OMX_U32 index;
+    gchar *path;
+
+    imp = g_omx_request_imp (library_name);
+
+    if (!imp)
+        return NULL;
+
+    /* Without it there's no telling what the library has. */
+    if (!imp->sym_table.component_name_enum)
+    {
+        g_omx_release_imp (imp);
+        return NULL;
+    }
+
+    key_file = g_key_file_new ();
+
+    for (index = 0; ; index++)
+    {
+        gchar name[OMX_MAX_STRINGNAME_SIZE];
+
+        if (imp->sym_table.component_name_enum (name, sizeof (name), index) != OMX_ErrorNone)
+            break;
+
+        probe_component (key_file, imp, name);
+    }
+
+    path = library_path (imp, library_name);
+    if (path)
+    {
+        struct stat st;
+
+        if (g_stat (path, &st) == 0)
+        {
+            gchar *mtime;
+
+            mtime = g_strdup_printf ("%lu", (gulong) st.st_mtime);
+            g_key_file_set_string (key_file, LIBRARY_GROUP, "name", library_name);
+            g_key_file_set_string (key_file, LIBRARY_GROUP, "path", path);
+            g_key_file_set_string (key_file, LIBRARY_GROUP, "mtime", mtime);
+            g_free (mtime);
+        }
+
+        {
+            gchar **files;
+            gchar **mtimes;
+
+            files = registration_files ();
+            mtimes = registration_mtimes (files);
+
+            g_key_file_set_string_list (key_file, LIBRARY_GROUP, "registration-files",
+                                        (const gchar * const *) files, g_strv_length (files));
+            g_key_file_set_string_list (key_file, LIBRARY_GROUP, "registration-mtimes",
+                                        (const gchar * const *) mtimes, g_strv_length (mtimes));
+
+            g_strfreev (mtimes);
+            g_strfreev (files);
+        }
+
+        g_free (path);
+    }
+
+    g_omx_release_imp (imp);
+
+    return key_file;
+}
+
+/*
+ * Cache
+ */
+
+/**
+ * The cache is only good for the same library, loaded from the same path,
+ * as long as neither it nor the registration files have been modified.
+ */
+static gboolean
+cache_valid (GKeyFile *key_file,
+             const gchar *library_name)
+{
+    gchar *name;
+    gchar *path;
+    gchar *mtime;
+    gchar **files;
+    gchar **mtimes;
+    struct stat st;
+    gboolean ret = FALSE;
+
+    name = g_key_file_get_string (key_file, LIBRARY_GROUP, "name", NULL);
+    path = g_key_file_get_string (key_file, LIBRARY_GROUP, "path", NULL);
+    mtime = g_key_file_get_string (key_file, LIBRARY_GROUP, "mtime", NULL);
+
+    if (name && path && mtime &&
+        strcmp (name, library_name) == 0 &&
+        g_stat (path, &st) == 0 &&
+        g_ascii_strtoull (mtime, NULL, 10) == (guint64) st.st_mtime)
+    {
+        gchar **cached;
+
+        files = registration_files ();
+        mtimes = registration_mtimes (files);
+
+        cached = g_key_file_get_string_list (key_file, LIBRARY_GROUP, "registration-files", NULL, NULL);
+        ret = strv_equal (cached, files);
+        g_strfreev (cached);
+
+        cached = g_key_file_get_string_list (key_file, LIBRARY_GROUP, "registration-mtimes", NULL, NULL);
+        ret = ret && strv_equal (cached, mtimes);
+        g_strfreev (cached);
+
+        g_strfreev (mtimes);
+        g_strfreev (files);
+    }
+
+    g_free (mtime);
+    g_free (path);
+    g_free (name);
+
+    return ret;
+}
+
+static void
+cache_save (GKeyFile *key_file,
+            const gchar *file)
+{
+    gchar *dir;
+    gchar *data;
+    gsize length;
+
+    /* If this fails, the next time we just probe again. */
+    dir = g_path_get_dirname (file);
+    g_mkdir_with_parents (dir, 0755);
+    g_free (dir);
+
+    data = g_key_file_to_data (key_file, &length, NULL);
+    if (data)
+        g_file_set_contents (file, data, length, NULL);
+    g_free (data);
+}
+
+gchar *
+g_omx_registry_get_cache_file (const gchar *library_name)
+{
+    gchar *base;
+    gchar *file;
+
+    base = g_strdup_printf ("%s.registry", library_name);
+    g_strdelimit (base, "/", '_');
+    file = g_build_filename (g_get_user_cache_dir (), "gst-openmax", base, NULL);
+    g_free (base);
+
+    return file;
+}
+
+/*
+ * Registry
+ */
+
+/**
+ * What the library provides, from the cache if it's still valid, or by
+ * probing the library otherwise. Returns NULL if the library can't be
+ * loaded, or can't list its components.
+ */
+GOmxRegistry *
+g_omx_registry_load (const gchar *library_name)
+{
+    GOmxRegistry *registry;
+    GKeyFile *key_file;
+    gchar *file;
+
+    file = g_omx_registry_get_cache_file (library_name);
+    key_file = g_key_file_new ();
+
+    if (!g_key_file_load_from_file (key_file, file, G_KEY_FILE_NONE, NULL) ||
+        !cache_valid (key_file, library_name))
+    {
+        g_key_file_free (key_file);
+        key_file = probe (library_name);
+        if (key_file)
+            cache_save (key_file, file);
+    }
+
+    g_free (file);
+
+    if (!key_file)
+        return NULL;
+
+    registry = g_new0 (GOmxRegistry, 1);
+    registry->key_file = key_file;
+
+    return registry;
+}
+
+void
+g_omx_registry_free (GOmxRegistry *registry)
+{
+    g_key_file_free (registry->key_file);
+    g_free (registry);
+}
+
+/**
+ * The files what the library provides depends on: the library itself, if
+ * it could be found, and the registration files. Free with g_strfreev().
+ */
+gchar **
+g_omx_registry_get_files (GOmxRegistry *registry)
+{
+    gchar **files;
+    gchar **registration;
+    gchar *path;
+    guint n;
+    guint i;
+
+    registration = g_key_file_get_string_list (registry->key_file, LIBRARY_GROUP,
+                                               "registration-files", NULL, NULL);
+    path = g_key_file_get_string (registry->key_file, LIBRARY_GROUP, "path", NULL);
+
+    files = g_new0 (gchar *, (registration ? g_strv_length (registration) : 0) + 2);
+    n = 0;
+
+    if (path)
+        files[n++] = path;
+
+    for (i = 0; registration && registration[i]; i++)
+        files[n++] = g_strdup (registration[i]);
+
+    g_strfreev (registration);
+
+    return files;
+}
+
+gboolean
+g_omx_registry_has_component (GOmxRegistry *registry,
+                              const gchar *component_name)
+{
+    return strcmp (component_name, LIBRARY_GROUP) != 0 &&
+        g_key_file_has_group (registry->key_file, component_name);
+}
+
+/** Free with g_strfreev(). */
+gchar **
+g_omx_registry_get_roles (GOmxRegistry *registry,
+                          const gchar *component_name)
+{
+    if (!g_omx_registry_has_component (registry, component_name))
+        return NULL;
+
+    return g_key_file_get_string_list (registry->key_file, component_name, "roles", NULL, NULL);
+}
+
+/** Free with g_strfreev(). */
+gchar **
+g_omx_registry_get_components_of_role (GOmxRegistry *registry,
+                                       const gchar *role)
+{
+    GPtrArray *components;
+    gchar **groups;
+    guint i;
+
+    components = g_ptr_array_new ();
+    groups = g_key_file_get_groups (registry->key_file, NULL);
+
+    for (i = 0; groups[i]; i++)
+    {
+        gchar **roles;
+        guint j;
+
+        roles = g_omx_registry_get_roles (registry, groups[i]);
+        if (!roles)
+            continue;
+
+        for (j = 0; roles[j]; j++)
+        {
+            if (strcmp (roles[j], role) == 0)
+            {
+                g_ptr_array_add (components, g_strdup (groups[i]));
+                break;
+            }
+        }
+
+        g_strfreev (roles);
+    }
+
+    g_strfreev (groups);
+    g_ptr_array_add (components, NULL);
+
+    return (gchar **) g_ptr_array_free (components, FALSE);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef GSTOMX_REGISTRY_H
+#define GSTOMX_REGISTRY_H
+
+#include <glib.h>
+
+/*
+ * What an IL library provides: its components, their roles, and their
+ * ports. Probing is slow, so the results are kept in a cache file per
+ * library, which is used for as long as neither the library nor the files
+ * its core registers components in change.
+ */
+
+typedef struct GOmxRegistry GOmxRegistry;
+
+GOmxRegistry *g_omx_registry_load (const gchar *library_name);
+void g_omx_registry_free (GOmxRegistry *registry);
+gchar *g_omx_registry_get_cache_file (const gchar *library_name);
+gchar **g_omx_registry_get_files (GOmxRegistry *registry);
+gboolean g_omx_registry_has_component (GOmxRegistry *registry, const gchar *component_name);
+gchar **g_omx_registry_get_roles (GOmxRegistry *registry, const gchar *component_name);
+gchar **g_omx_registry_get_components_of_role (GOmxRegistry *registry, const gchar *role);
+
+#endif /* GSTOMX_REGISTRY_H */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "gstomx_stats.h"
+
+static void
+set_wait_stats (GstStructure *structure,
+                const WaitStats *waits)
+{
+    GValue histogram = { 0 };
+    guint i;
+
+    g_value_init (&histogram, GST_TYPE_ARRAY);
+
+    for (i = 0; i < WAIT_STATS_BUCKETS; i++)
+    {
+        GValue bucket = { 0 };
+
+        g_value_init (&bucket, G_TYPE_UINT);
+        g_value_set_uint (&bucket, waits->histogram[i]);
+        gst_value_array_append_value (&histogram, &bucket);
+        g_value_unset (&bucket);
+    }
+
+    gst_structure_set (structure,
+                       "waits", G_TYPE_UINT, waits->count,
+                       "wait-time", G_TYPE_UINT64, waits->time,
+                       NULL);
+
+    gst_structure_set_value (structure, "wait-histogram", &histogram);
+    g_value_unset (&histogram);
+}
+
+static void
+add_port_stats (GstStructure *structure,
+                GOmxPort *port,
+                guint index)
+{
+    GstStructure *port_structure;
+    AsyncQueueStats stats;
+    gchar *name;
+
+    g_omx_port_get_stats (port, &stats);
+
+    name = g_strdup_printf ("%s-%u",
+                            port->type == GOMX_PORT_INPUT ? "input" : "output",
+                            index);
+
+    port_structure = gst_structure_empty_new (name);
+
+    gst_structure_set (port_structure,
+                       "capacity", G_TYPE_UINT, port->num_buffers,
+                       "in-component", G_TYPE_INT, g_atomic_int_get (&port->component_buffers),
+                       "queued", G_TYPE_UINT, stats.length,
+                       "max-queued", G_TYPE_UINT, stats.max_length,
+                       "pushes", G_TYPE_UINT, stats.pushes,
+                       "pops", G_TYPE_UINT, stats.pops,
+                       "disabled-pops", G_TYPE_UINT, stats.disabled_pops,
+                       "lent", G_TYPE_UINT, port->lent,
+                       NULL);
+
+    if (port->count)
+    {
+        gst_structure_set (port_structure,
+                           "buffers-wanted", G_TYPE_INT, port->count->wanted,
+                           "warming-up", G_TYPE_BOOLEAN, g_atomic_int_get (&port->warming_up) != 0,
+                           "grow", G_TYPE_BOOLEAN, port->count->grow,
+                           NULL);
+    }
+
+    set_wait_stats (port_structure, &stats.waits);
+
+    gst_structure_set (structure, name, GST_TYPE_STRUCTURE, port_structure, NULL);
+
+    gst_structure_free (port_structure);
+    g_free (name);
+}
+
+static void
+add_sem_stats (GstStructure *structure,
+               const gchar *name,
+               GOmxSem *sem)
+{
+    GstStructure *sem_structure;
+    GOmxSemStats stats;
+
+    g_omx_sem_get_stats (sem, &stats);
+
+    sem_structure = gst_structure_empty_new (name);
+
+    gst_structure_set (sem_structure,
+                       "ups", G_TYPE_UINT, stats.ups,
+                       "downs", G_TYPE_UINT, stats.downs,
+                       "timeouts", G_TYPE_UINT, stats.timeouts,
+                       NULL);
+
+    set_wait_stats (sem_structure, &stats.waits);
+
+    gst_structure_set (structure, name, GST_TYPE_STRUCTURE, sem_structure, NULL);
+
+    gst_structure_free (sem_structure);
+}
+
+/**
+ * Queue and semaphore statistics of core, for the "stats" property of the
+ * elements. There is one sub-structure per port, named after its direction
+ * and index; wait times are in microseconds, and bucket n of the histograms
+ * counts waits shorter than 2^n microseconds.
+ */
+GstStructure *
+gstomx_get_stats (GOmxCore *core)
+{
+    GstStructure *structure;
+    guint index;
+
+    structure = gst_structure_new ("omx-stats",
+                                   "buffers-done", G_TYPE_INT, g_atomic_int_get (&core->buffer_count),
+                                   NULL);
+
+    for (index = 0; index < core->ports->len; index++)
+    {
+        GOmxPort *port;
+
+        port = g_ptr_array_index (core->ports, index);
+
+        if (port && port->queue)
+            add_port_stats (structure, port, index);
+    }
+
+    {
+        GstStructure *state_structure;
+        WaitStats waits;
+
+        g_omx_core_get_state_stats (core, &waits);
+
+        state_structure = gst_structure_empty_new ("state");
+        set_wait_stats (state_structure, &waits);
+        gst_structure_set (structure, "state", GST_TYPE_STRUCTURE, state_structure, NULL);
+        gst_structure_free (state_structure);
+    }
+
+    add_sem_stats (structure, "done-sem", core->done_sem);
+    add_sem_stats (structure, "flush-sem", core->flush_sem);
+
+    return structure;
+}
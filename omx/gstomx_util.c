@@ -22,6 +22,26 @@
 
 #include "gstomx_util.h"
 #include <dlfcn.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+/** Bytes buffers are aligned to at least; a cache line, and wide enough for any SIMD. */
+#define SLAB_ALIGNMENT 64
+
+/** Buffers auto watches a port for, after the first round. */
+#define WARMUP_POPS 64
+/** States of a port's warming_up; zeroed ports aren't watched. */
+enum
+{
+    WARMUP_DONE,
+    WARMUP_IDLE,
+    WARMUP_BUSY
+};
+/** Auto grows a port if more than 1 in this many requests had to wait. */
+#define STARVING_RATIO 4
+/** Auto doesn't go beyond this many times the component's minimum. */
+#define AUTO_BUFFERS_FACTOR 4
 
 /*
  * Forward declarations
@@ -31,6 +51,11 @@ inline void
 change_state (GOmxCore *core,
               OMX_STATETYPE state);
 
+static gboolean
+state_reached (GOmxCore *core,
+               OMX_STATETYPE state,
+               gulong timeout);
+
 inline void
 wait_for_state (GOmxCore *core,
                 OMX_STATETYPE state);
@@ -70,10 +95,65 @@ inline GOmxPort *
 g_omx_core_get_port (GOmxCore *core,
                      guint index);
 
+static OMX_ERRORTYPE
+port_alloc_buffers (GOmxCore *core,
+                    GOmxPort *port,
+                    guint index);
+
+static void
+port_free_buffers (GOmxCore *core,
+                   GOmxPort *port,
+                   guint index);
+
+static void
+port_return_data (GOmxPort *port,
+                  OMX_BUFFERHEADERTYPE *omx_buffer);
+
+static void
+watchdog_start (GOmxCore *core);
+
+static void
+watchdog_stop (GOmxCore *core);
+
 static OMX_CALLBACKTYPE callbacks = { EventHandler, EmptyBufferDone, FillBufferDone };
 
 static GHashTable *implementations;
 static gboolean initialized;
+static guint linger; /**< Seconds an unused core stays initialized. */
+
+static Dispatcher *dispatcher;
+G_LOCK_DEFINE_STATIC (dispatcher);
+
+/**
+ * A component instance. The callbacks get this, not the core, so the
+ * instance can be handed from one core to another.
+ */
+struct GOmxHandle
+{
+    OMX_HANDLETYPE omx_handle;
+    GOmxImp *imp;
+    gchar *library_name;
+    gchar *component_name;
+    gchar *role; /**< What it was opened for; NULL if nothing in particular. */
+    OMX_PARAM_PORTDEFINITIONTYPE *defaults; /**< Its ports as first opened; see handle_probe_ports. */
+    guint n_defaults;
+    gboolean probed;
+    GOmxCore *core; /**< Current user; NULL while pooled. */
+    GTimeVal idle_since;
+};
+
+static GList *pool; /**< Idle handles, most recently used first. */
+static guint pool_max; /**< 0 disables the pool. */
+static guint pool_idle; /**< Seconds a handle may stay idle; 0 is forever. */
+static GMutex *registry_mutex; /**< Protects implementations, client counts and the pool. */
+static GCond *registry_cond;
+static GThread *reaper; /**< Frees idle handles and unused cores. */
+static gboolean reaper_quit;
+
+static gchar **known_libraries; /**< What "auto" stands for. */
+
+static GThread *preloader;
+static GList *preloaded; /**< Implementations kept initialized until g_omx_deinit. */
 
 static void
 g_ptr_array_clear (GPtrArray *array)
@@ -109,6 +189,7 @@ imp_new (const gchar *name)
     GOmxImp *imp;
 
     imp = g_new0 (GOmxImp, 1);
+    imp->mutex = g_mutex_new ();
 
     /* Load the OpenMAX IL symbols */
     {
@@ -126,6 +207,11 @@ imp_new (const gchar *name)
         imp->sym_table.deinit = dlsym (handle, "OMX_Deinit");
         imp->sym_table.get_handle = dlsym (handle, "OMX_GetHandle");
         imp->sym_table.free_handle = dlsym (handle, "OMX_FreeHandle");
+
+        /* Optional; used to find out what the library provides. */
+        imp->sym_table.component_name_enum = dlsym (handle, "OMX_ComponentNameEnum");
+        imp->sym_table.get_roles_of_component = dlsym (handle, "OMX_GetRolesOfComponent");
+        imp->sym_table.get_components_of_role = dlsym (handle, "OMX_GetComponentsOfRole");
     }
 
     return imp;
@@ -134,44 +220,116 @@ imp_new (const gchar *name)
 static void
 imp_free (GOmxImp *imp)
 {
+    if (imp->initialized)
+    {
+        imp->sym_table.deinit ();
+    }
     if (imp->dl_handle)
     {
         dlclose (imp->dl_handle);
     }
+    g_mutex_free (imp->mutex);
     g_free (imp);
 }
 
+/* Lock order is imp->mutex, then registry_mutex. */
+
+static void
+imp_deinit_if_unused (GOmxImp *imp)
+{
+    gboolean unused;
+
+    g_mutex_lock (imp->mutex);
+
+    g_mutex_lock (registry_mutex);
+    unused = (imp->client_count == 0);
+    g_mutex_unlock (registry_mutex);
+
+    if (unused && imp->initialized)
+    {
+        imp->sym_table.deinit ();
+        imp->initialized = FALSE;
+    }
+
+    g_mutex_unlock (imp->mutex);
+}
+
+static inline void
+release_imp (GOmxImp *imp)
+{
+    gboolean now = FALSE;
+
+    g_mutex_lock (registry_mutex);
+    imp->client_count--;
+    if (imp->client_count == 0)
+    {
+        if (linger)
+        {
+            /* The reaper deinitializes it unless somebody wants it back. */
+            imp->lingering = TRUE;
+            g_get_current_time (&imp->idle_since);
+            g_cond_signal (registry_cond);
+        }
+        else
+        {
+            now = TRUE;
+        }
+    }
+    g_mutex_unlock (registry_mutex);
+
+    if (now)
+        imp_deinit_if_unused (imp);
+}
+
 static inline GOmxImp *
 request_imp (const gchar *name)
 {
     GOmxImp *imp;
+    gboolean ok;
+
+    g_mutex_lock (registry_mutex);
     imp = g_hash_table_lookup (implementations, name);
     if (!imp)
     {
-        imp = imp_new (name);
-        if (!imp)
-            return NULL;
-        g_hash_table_insert (implementations, g_strdup (name), imp);
-    }
-    if (imp->client_count == 0)
-    {
-        OMX_ERRORTYPE omx_error;
-        omx_error = imp->sym_table.init ();
-        if (omx_error)
+        GOmxImp *loaded;
+
+        /* dlopen can take a while; don't hold up the other libraries. */
+        g_mutex_unlock (registry_mutex);
+        loaded = imp_new (name);
+        if (!loaded)
             return NULL;
+        g_mutex_lock (registry_mutex);
+
+        /* Somebody may have loaded it in the meantime. */
+        imp = g_hash_table_lookup (implementations, name);
+        if (imp)
+        {
+            imp_free (loaded);
+        }
+        else
+        {
+            imp = loaded;
+            g_hash_table_insert (implementations, g_strdup (name), imp);
+        }
     }
+    /* Nobody deinitializes it while we hold a reference. */
     imp->client_count++;
-    return imp;
-}
+    imp->lingering = FALSE;
+    g_mutex_unlock (registry_mutex);
 
-static inline void
-release_imp (GOmxImp *imp)
-{
-    imp->client_count--;
-    if (imp->client_count == 0)
+    g_mutex_lock (imp->mutex);
+    if (!imp->initialized)
+        imp->initialized = (imp->sym_table.init () == OMX_ErrorNone);
+    ok = imp->initialized;
+    g_mutex_unlock (imp->mutex);
+
+    if (!ok)
     {
-        imp->sym_table.deinit ();
+        release_imp (imp);
+        return NULL;
     }
+
+    return imp;
 }
 
 void
@@ -180,6 +338,8 @@ g_omx_init (void)
     if (!initialized)
     {
         implementations = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) imp_free);
+        registry_mutex = g_mutex_new ();
+        registry_cond = g_cond_new ();
         initialized = true;
     }
 }
@@ -189,222 +349,1153 @@ g_omx_deinit (void)
 {
     if (initialized)
     {
+        g_omx_preload_wait ();
+
+        {
+            GList *l;
+            for (l = preloaded; l; l = l->next)
+                release_imp (l->data);
+            g_list_free (preloaded);
+            preloaded = NULL;
+        }
+
+        g_omx_set_handle_pool (0, 0);
+
+        g_mutex_lock (registry_mutex);
+        reaper_quit = TRUE;
+        g_cond_signal (registry_cond);
+        g_mutex_unlock (registry_mutex);
+
+        if (reaper)
+        {
+            g_thread_join (reaper);
+            reaper = NULL;
+        }
+        reaper_quit = FALSE;
+
+        /* Deinitializes the lingering cores too. */
         g_hash_table_destroy (implementations);
+
+        g_strfreev (known_libraries);
+        known_libraries = NULL;
+
+        g_cond_free (registry_cond);
+        g_mutex_free (registry_mutex);
         initialized = false;
     }
+
+    G_LOCK (dispatcher);
+    if (dispatcher)
+    {
+        dispatcher_free (dispatcher);
+        dispatcher = NULL;
+    }
+    G_UNLOCK (dispatcher);
 }
 
-/*
- * Core
- */
+/** An initialized library, for those that need to talk to the core directly. */
+GOmxImp *
+g_omx_request_imp (const gchar *library_name)
+{
+    return request_imp (library_name);
+}
 
-GOmxCore *
-g_omx_core_new (void)
+void
+g_omx_release_imp (GOmxImp *imp)
 {
-    GOmxCore *core;
+    release_imp (imp);
+}
 
-    core = g_new0 (GOmxCore, 1);
+static gpointer
+preload_thread (gpointer data)
+{
+    gchar **names;
+    gchar **name;
 
-    core->ports = g_ptr_array_new ();
+    names = data;
 
-    core->state_sem = g_omx_sem_new ();
-    core->done_sem = g_omx_sem_new ();
-    core->flush_sem = g_omx_sem_new ();
+    for (name = names; *name; name++)
+    {
+        GOmxImp *imp;
 
-    core->omx_state = OMX_StateInvalid;
+        imp = request_imp (*name);
+        if (!imp)
+        {
+            g_warning ("couldn't preload %s\n", *name);
+            continue;
+        }
 
-    return core;
+        g_mutex_lock (registry_mutex);
+        preloaded = g_list_prepend (preloaded, imp);
+        g_mutex_unlock (registry_mutex);
+    }
+
+    g_strfreev (names);
+
+    return NULL;
 }
 
+/**
+ * Loads and initializes the libraries in a thread of their own, so the
+ * first element doesn't have to; they stay initialized until
+ * g_omx_deinit(). An element that gets there first simply waits for the
+ * initialization in progress.
+ */
 void
-g_omx_core_free (GOmxCore *core)
+g_omx_preload (const gchar *const *library_names)
 {
-    g_omx_sem_free (core->flush_sem);
-    g_omx_sem_free (core->done_sem);
-    g_omx_sem_free (core->state_sem);
-
-    g_ptr_array_free (core->ports, TRUE);
-
-    g_free (core);
+    g_omx_preload_wait ();
+    preloader = g_thread_create (preload_thread, g_strdupv ((gchar **) library_names), TRUE, NULL);
 }
 
+/** Waits until the libraries given to g_omx_preload() are ready. */
 void
-g_omx_core_init (GOmxCore *core,
-                 const gchar *library_name,
-                 const gchar *component_name)
+g_omx_preload_wait (void)
 {
-    core->imp = request_imp (library_name);
-
-    if (!core->imp)
+    if (preloader)
     {
-        core->omx_error = OMX_ErrorUndefined;
-        return;
+        g_thread_join (preloader);
+        preloader = NULL;
     }
-
-    core->omx_error = core->imp->sym_table.get_handle (&core->omx_handle, (gchar *) component_name, core, &callbacks);
-    core->omx_state = OMX_StateLoaded;
 }
 
-void
-g_omx_core_deinit (GOmxCore *core)
+/**
+ * The dispatcher shared by all the elements: one thread per CPU waiting,
+ * and a pool pushing. Returns NULL if it isn't supported.
+ */
+Dispatcher *
+g_omx_get_dispatcher (void)
 {
-    if (!core->imp)
-        return;
-
-    core->omx_error = core->imp->sym_table.free_handle (core->omx_handle);
+    Dispatcher *ret;
 
-    if (core->omx_error)
-        return;
+    G_LOCK (dispatcher);
+    if (!dispatcher)
+    {
+        glong n_threads;
+        n_threads = sysconf (_SC_NPROCESSORS_ONLN);
+        dispatcher = dispatcher_new (n_threads > 0 ? n_threads : 1);
+    }
+    ret = dispatcher;
+    G_UNLOCK (dispatcher);
 
-    release_imp (core->imp);
-    core->imp = NULL;
+    return ret;
 }
 
-void
-g_omx_core_prepare (GOmxCore *core)
+/*
+ * Handle pool
+ */
+
+static void
+handle_free (GOmxHandle *handle)
 {
-    change_state (core, OMX_StateIdle);
+    if (handle->imp->sym_table.free_handle (handle->omx_handle) == OMX_ErrorNone)
+        release_imp (handle->imp);
+
+    g_free (handle->library_name);
+    g_free (handle->component_name);
+    g_free (handle->role);
+    g_free (handle->defaults);
+    g_free (handle);
+}
 
-    /* Allocate buffers. */
+/**
+ * Remembers the port definitions of a handle fresh from the library, with
+ * its role taken; whoever gets it from the pool gets them back, whatever
+ * the previous user changed. The ports are the ones the component lists
+ * for each domain.
+ */
+static void
+handle_probe_ports (GOmxHandle *handle)
+{
+    static const OMX_INDEXTYPE domains[] = {
+        OMX_IndexParamAudioInit,
+        OMX_IndexParamVideoInit,
+        OMX_IndexParamImageInit,
+        OMX_IndexParamOtherInit
+    };
+    guint d;
+
+    for (d = 0; d < G_N_ELEMENTS (domains); d++)
     {
-        guint index;
+        OMX_PORT_PARAM_TYPE ports;
         guint i;
 
-        for (index = 0; index < core->ports->len; index++)
-        {
-            GOmxPort *port;
+        memset (&ports, 0, sizeof (ports));
+        ports.nSize = sizeof (ports);
+        ports.nVersion.s.nVersionMajor = 1;
+        ports.nVersion.s.nVersionMinor = 1;
 
-            port = g_omx_core_get_port (core, index);
+        if (OMX_GetParameter (handle->omx_handle, domains[d], &ports) != OMX_ErrorNone)
+            continue;
 
-            if (port)
-            {
-                for (i = 0; i < port->num_buffers; i++)
-                {
-                    gpointer buffer_data;
-                    guint size;
+        for (i = 0; i < ports.nPorts; i++)
+        {
+            OMX_PARAM_PORTDEFINITIONTYPE param;
 
-                    size = port->buffer_size;
-                    buffer_data = g_malloc (size);
+            memset (&param, 0, sizeof (param));
+            param.nSize = sizeof (param);
+            param.nVersion.s.nVersionMajor = 1;
+            param.nVersion.s.nVersionMinor = 1;
+            param.nPortIndex = ports.nStartPortNumber + i;
 
-                    OMX_UseBuffer (core->omx_handle,
-                                   &port->buffers[i],
-                                   index,
-                                   NULL,
-                                   size,
-                                   buffer_data);
-                }
-            }
+            if (OMX_GetParameter (handle->omx_handle, OMX_IndexParamPortDefinition, &param) != OMX_ErrorNone)
+                continue;
+
+            handle->defaults = g_renew (OMX_PARAM_PORTDEFINITIONTYPE, handle->defaults, handle->n_defaults + 1);
+            handle->defaults[handle->n_defaults++] = param;
         }
     }
 
-    wait_for_state (core, OMX_StateIdle);
+    handle->probed = TRUE;
 }
 
-void
-g_omx_core_start (GOmxCore *core)
+/** Returns FALSE if the component didn't take its defaults back. */
+static gboolean
+handle_reset_ports (GOmxHandle *handle)
 {
-    change_state (core, OMX_StateExecuting);
-
-    wait_for_state (core, OMX_StateExecuting);
+    guint index;
 
+    for (index = 0; index < handle->n_defaults; index++)
     {
-        guint index;
-        guint i;
-
-        for (index = 0; index < core->ports->len; index++)
-        {
-            GOmxPort *port;
-
-            port = g_omx_core_get_port (core, index);
-
-            for (i = 0; i < port->num_buffers; i++)
-            {
-                OMX_BUFFERHEADERTYPE *omx_buffer;
+        OMX_PARAM_PORTDEFINITIONTYPE param;
 
-                omx_buffer = port->buffers[i];
+        param = handle->defaults[index];
 
-                got_buffer (core, port, omx_buffer);
-            }
-        }
+        if (OMX_SetParameter (handle->omx_handle, OMX_IndexParamPortDefinition, &param) != OMX_ErrorNone)
+            return FALSE;
     }
+
+    return TRUE;
 }
 
-void
-g_omx_core_pause (GOmxCore *core)
+static void
+handle_list_free (GList *list)
 {
-    change_state (core, OMX_StatePause);
-
-    wait_for_state (core, OMX_StatePause);
+    GList *l;
+    for (l = list; l; l = l->next)
+        handle_free (l->data);
+    g_list_free (list);
 }
 
-void
-g_omx_core_finish (GOmxCore *core)
+/** Removes the handles that have been idle for too long; registry_mutex must be held. */
+static GList *
+pool_expire (const GTimeVal *now)
 {
-    change_state (core, OMX_StateIdle);
-
-    wait_for_state (core, OMX_StateIdle);
+    GList *expired = NULL;
+    GList *l;
 
-    change_state (core, OMX_StateLoaded);
+    if (!pool_idle)
+        return NULL;
 
+    l = pool;
+    while (l)
     {
-        guint index;
-        guint i;
+        GOmxHandle *handle;
+        GList *next;
 
-        for (index = 0; index < core->ports->len; index++)
-        {
-            GOmxPort *port;
-
-            port = g_omx_core_get_port (core, index);
-
-            for (i = 0; i < port->num_buffers; i++)
-            {
-                OMX_BUFFERHEADERTYPE *omx_buffer;
-
-                omx_buffer = port->buffers[i];
-
-                g_free (omx_buffer->pBuffer);
+        handle = l->data;
+        next = l->next;
 
-                OMX_FreeBuffer (core->omx_handle, index, omx_buffer);
-            }
+        if (now->tv_sec - handle->idle_since.tv_sec >= (glong) pool_idle)
+        {
+            pool = g_list_delete_link (pool, l);
+            expired = g_list_prepend (expired, handle);
         }
+
+        l = next;
     }
 
-    wait_for_state (core, OMX_StateLoaded);
+    return expired;
+}
+
+/** Removes the least recently used handles above the limit; registry_mutex must be held. */
+static GList *
+pool_trim (void)
+{
+    GList *evicted = NULL;
 
+    while (g_list_length (pool) > pool_max)
     {
-        guint index;
-        for (index = 0; index < core->ports->len; index++)
-        {
-            GOmxPort *port;
-            port = g_omx_core_get_port (core, index);
-            g_omx_port_free (port);
-        }
-        g_ptr_array_clear (core->ports);
+        GList *last;
+        last = g_list_last (pool);
+        evicted = g_list_prepend (evicted, last->data);
+        pool = g_list_delete_link (pool, last);
     }
+
+    return evicted;
 }
 
-GOmxPort *
-g_omx_core_setup_port (GOmxCore *core,
-                       OMX_PARAM_PORTDEFINITIONTYPE *omx_port)
+typedef struct
 {
-    GOmxPort *port;
-    guint index;
+    const GTimeVal *now;
+    GList *expired; /**< Cores that lingered long enough. */
+    glong next; /**< When the next one is due; 0 if none. */
+} LingerSweep;
 
-    index = omx_port->nPortIndex;
-    port = g_omx_core_get_port (core, index);
+static void
+linger_sweep (gpointer key,
+              gpointer value,
+              gpointer data)
+{
+    GOmxImp *imp;
+    LingerSweep *sweep;
+    glong due;
 
-    if (!port)
+    imp = value;
+    sweep = data;
+
+    if (!imp->lingering)
+        return;
+
+    due = imp->idle_since.tv_sec + linger;
+
+    if (due <= sweep->now->tv_sec)
     {
-        port = g_omx_port_new (core);
+        imp->lingering = FALSE;
+        sweep->expired = g_list_prepend (sweep->expired, imp);
     }
+    else if (!sweep->next || due < sweep->next)
+    {
+        sweep->next = due;
+    }
+}
 
-    g_omx_port_setup (port, omx_port);
+static gpointer reaper_thread (gpointer data);
 
+/** Must be called with registry_mutex held. */
+static void
+reaper_start (void)
+{
+    if (!reaper)
+        reaper = g_thread_create (reaper_thread, NULL, TRUE, NULL);
+}
+
+static gpointer
+reaper_thread (gpointer data)
+{
+    g_mutex_lock (registry_mutex);
+
+    while (!reaper_quit)
+    {
+        GTimeVal now;
+        GList *expired;
+        LingerSweep sweep;
+
+        g_get_current_time (&now);
+        expired = pool_expire (&now);
+
+        sweep.now = &now;
+        sweep.expired = NULL;
+        sweep.next = 0;
+        g_hash_table_foreach (implementations, linger_sweep, &sweep);
+
+        if (expired || sweep.expired)
+        {
+            GList *l;
+
+            g_mutex_unlock (registry_mutex);
+            handle_list_free (expired);
+            for (l = sweep.expired; l; l = l->next)
+                imp_deinit_if_unused (l->data);
+            g_list_free (sweep.expired);
+            g_mutex_lock (registry_mutex);
+            continue;
+        }
+
+        if (pool && pool_idle)
+        {
+            GOmxHandle *oldest;
+            glong due;
+
+            oldest = g_list_last (pool)->data;
+            due = oldest->idle_since.tv_sec + pool_idle;
+            if (!sweep.next || due < sweep.next)
+                sweep.next = due;
+        }
+
+        if (sweep.next)
+        {
+            GTimeVal deadline;
+
+            deadline.tv_sec = sweep.next;
+            deadline.tv_usec = 0;
+            g_cond_timed_wait (registry_cond, registry_mutex, &deadline);
+        }
+        else
+        {
+            g_cond_wait (registry_cond, registry_mutex);
+        }
+    }
+
+    g_mutex_unlock (registry_mutex);
+
+    return NULL;
+}
+
+/**
+ * Keeps a core initialized for seconds after its last component is freed,
+ * so starting again soon doesn't pay for OMX_Init. 0, the default,
+ * deinitializes right away.
+ */
+void
+g_omx_set_linger (guint seconds)
+{
+    g_mutex_lock (registry_mutex);
+    linger = seconds;
+    if (linger)
+        reaper_start ();
+    g_cond_signal (registry_cond);
+    g_mutex_unlock (registry_mutex);
+}
+
+/**
+ * Keeps up to max component handles alive after their elements are done
+ * with them, so the next element that wants the same component doesn't
+ * have to create one. Handles idle for more than idle seconds are freed;
+ * 0 keeps them until they are evicted. A max of 0 disables the pool,
+ * which is the default.
+ */
+void
+g_omx_set_handle_pool (guint max,
+                       guint idle)
+{
+    GList *evicted;
+
+    g_mutex_lock (registry_mutex);
+    pool_max = max;
+    pool_idle = idle;
+    evicted = pool_trim ();
+    if (pool_max && pool_idle)
+        reaper_start ();
+    g_cond_signal (registry_cond);
+    g_mutex_unlock (registry_mutex);
+
+    handle_list_free (evicted);
+}
+
+/** Takes a handle of component_name from library_name, opened for role. */
+static GOmxHandle *
+pool_take (const gchar *library_name,
+           const gchar *component_name,
+           const gchar *role)
+{
+    GOmxHandle *handle = NULL;
+    GList *l;
+
+    g_mutex_lock (registry_mutex);
+    for (l = pool; l; l = l->next)
+    {
+        GOmxHandle *cur;
+        cur = l->data;
+        if (strcmp (cur->library_name, library_name) == 0 &&
+            strcmp (cur->component_name, component_name) == 0 &&
+            (cur->role == role ||
+             (cur->role && role && strcmp (cur->role, role) == 0)))
+        {
+            handle = cur;
+            pool = g_list_delete_link (pool, l);
+            break;
+        }
+    }
+    g_mutex_unlock (registry_mutex);
+
+    return handle;
+}
+
+/** Returns FALSE if the pool doesn't want the handle. */
+static gboolean
+pool_put (GOmxHandle *handle)
+{
+    GList *evicted;
+
+    g_mutex_lock (registry_mutex);
+    if (!pool_max)
+    {
+        g_mutex_unlock (registry_mutex);
+        return FALSE;
+    }
+    handle->core = NULL;
+    g_get_current_time (&handle->idle_since);
+    pool = g_list_prepend (pool, handle);
+    evicted = pool_trim ();
+    g_cond_signal (registry_cond);
+    g_mutex_unlock (registry_mutex);
+
+    handle_list_free (evicted);
+
+    return TRUE;
+}
+
+/*
+ * Core
+ */
+
+GOmxCore *
+g_omx_core_new (void)
+{
+    GOmxCore *core;
+
+    core = g_new0 (GOmxCore, 1);
+
+    core->ports = g_ptr_array_new ();
+
+    core->state_mutex = g_mutex_new ();
+    core->state_cond = g_cond_new ();
+    core->done_sem = g_omx_sem_new ();
+    core->flush_sem = g_omx_sem_new ();
+
+    core->watchdog_mutex = g_mutex_new ();
+    core->watchdog_cond = g_cond_new ();
+
+    core->omx_state = OMX_StateInvalid;
+
+    return core;
+}
+
+void
+g_omx_core_free (GOmxCore *core)
+{
+    watchdog_stop (core);
+
+    g_cond_free (core->watchdog_cond);
+    g_mutex_free (core->watchdog_mutex);
+
+    g_omx_sem_free (core->flush_sem);
+    g_omx_sem_free (core->done_sem);
+    g_cond_free (core->state_cond);
+    g_mutex_free (core->state_mutex);
+
+    g_ptr_array_free (core->ports, TRUE);
+
+    g_strfreev (core->libraries);
+    g_free (core->component_name);
+    g_free (core->role);
+
+    g_free (core);
+}
+
+/** Gets a component from library_name; omx_error says whether it worked. */
+static void
+open_component (GOmxCore *core,
+                const gchar *library_name,
+                const gchar *component_name)
+{
+    GOmxHandle *handle;
+
+    handle = pool_take (library_name, component_name, core->role);
+
+    /* Only as the previous user found it. */
+    if (handle && !handle_reset_ports (handle))
+    {
+        handle_free (handle);
+        handle = NULL;
+    }
+
+    if (handle)
+    {
+        handle->core = core;
+        core->handle = handle;
+        core->imp = handle->imp;
+        core->omx_handle = handle->omx_handle;
+        core->omx_error = OMX_ErrorNone;
+        core->omx_state = OMX_StateLoaded;
+        return;
+    }
+
+    core->imp = request_imp (library_name);
+
+    if (!core->imp)
+    {
+        core->omx_error = OMX_ErrorUndefined;
+        return;
+    }
+
+    handle = g_new0 (GOmxHandle, 1);
+    handle->imp = core->imp;
+    handle->library_name = g_strdup (library_name);
+    handle->component_name = g_strdup (component_name);
+    handle->role = g_strdup (core->role);
+    handle->core = core;
+
+    core->omx_error = core->imp->sym_table.get_handle (&handle->omx_handle, (gchar *) component_name, handle, &callbacks);
+
+    if (core->omx_error)
+    {
+        release_imp (core->imp);
+        core->imp = NULL;
+        g_free (handle->library_name);
+        g_free (handle->component_name);
+        g_free (handle->role);
+        g_free (handle);
+        return;
+    }
+
+    core->handle = handle;
+    core->omx_handle = handle->omx_handle;
+    core->omx_state = OMX_StateLoaded;
+}
+
+/** Frees the component for good, whatever state it was left in. */
+static void
+close_component (GOmxCore *core)
+{
+    guint index;
+
+    for (index = 0; index < core->ports->len; index++)
+    {
+        GOmxPort *port;
+
+        port = g_omx_core_get_port (core, index);
+        if (!port)
+            continue;
+
+        port_free_buffers (core, port, index);
+        g_omx_port_free (port);
+    }
+    g_ptr_array_clear (core->ports);
+
+    if (core->imp->sym_table.free_handle (core->omx_handle) == OMX_ErrorNone)
+        release_imp (core->imp);
+
+    core->imp = NULL;
+    core->omx_handle = NULL;
+
+    g_free (core->handle->library_name);
+    g_free (core->handle->component_name);
+    g_free (core->handle->role);
+    g_free (core->handle->defaults);
+    g_free (core->handle);
+    core->handle = NULL;
+}
+
+/**
+ * Opens the component from the first library left that has it, and takes
+ * the role. Components that don't know about roles are taken as they are.
+ */
+static void
+open_next (GOmxCore *core)
+{
+    core->omx_error = OMX_ErrorComponentNotFound;
+
+    while (core->libraries[core->next_library])
+    {
+        const gchar *library_name;
+
+        library_name = core->libraries[core->next_library++];
+
+        open_component (core, library_name, core->component_name);
+        if (core->omx_error)
+            continue;
+
+        if (core->role)
+        {
+            OMX_ERRORTYPE error;
+
+            error = g_omx_core_set_role (core, core->role);
+            if (error != OMX_ErrorNone && error != OMX_ErrorUnsupportedIndex)
+            {
+                close_component (core);
+                core->omx_error = error;
+                continue;
+            }
+        }
+
+        if (!core->handle->probed)
+            handle_probe_ports (core->handle);
+
+        return;
+    }
+}
+
+/**
+ * library_names is a ':' separated list; "auto" stands for the libraries
+ * given to g_omx_set_libraries().
+ */
+gchar **
+g_omx_expand_libraries (const gchar *library_names)
+{
+    GPtrArray *array;
+    gchar **names;
+    guint i;
+
+    array = g_ptr_array_new ();
+    names = g_strsplit (library_names, ":", 0);
+
+    for (i = 0; names[i]; i++)
+    {
+        g_strstrip (names[i]);
+
+        if (strcmp (names[i], "auto") == 0)
+        {
+            guint j;
+
+            g_mutex_lock (registry_mutex);
+            for (j = 0; known_libraries && known_libraries[j]; j++)
+                g_ptr_array_add (array, g_strdup (known_libraries[j]));
+            g_mutex_unlock (registry_mutex);
+        }
+        else if (*names[i])
+        {
+            g_ptr_array_add (array, g_strdup (names[i]));
+        }
+    }
+
+    g_strfreev (names);
+
+    g_ptr_array_add (array, NULL);
+
+    return (gchar **) g_ptr_array_free (array, FALSE);
+}
+
+/** The libraries "auto" tries, in order. */
+void
+g_omx_set_libraries (const gchar *const *library_names)
+{
+    g_mutex_lock (registry_mutex);
+    g_strfreev (known_libraries);
+    known_libraries = g_strdupv ((gchar **) library_names);
+    g_mutex_unlock (registry_mutex);
+}
+
+void
+g_omx_core_init (GOmxCore *core,
+                 const gchar *library_name,
+                 const gchar *component_name)
+{
+    g_omx_core_init_role (core, library_name, component_name, NULL);
+}
+
+/**
+ * Tries each of library_names in turn, until one has the component and
+ * lets it take role (if not NULL). The rest are kept for
+ * g_omx_core_failover().
+ */
+void
+g_omx_core_init_role (GOmxCore *core,
+                      const gchar *library_names,
+                      const gchar *component_name,
+                      const gchar *role)
+{
+    g_strfreev (core->libraries);
+    g_free (core->component_name);
+    g_free (core->role);
+
+    core->libraries = g_omx_expand_libraries (library_names);
+    core->next_library = 0;
+    core->component_name = g_strdup (component_name);
+    core->role = g_strdup (role);
+
+    open_next (core);
+}
+
+/**
+ * After the component failed for lack of resources, replaces it with the
+ * same one from the next library that has it. The ports are gone; the
+ * caller sets them up again. Returns FALSE if there was no other one.
+ */
+gboolean
+g_omx_core_failover (GOmxCore *core)
+{
+    if (core->omx_error != OMX_ErrorInsufficientResources || !core->imp)
+        return FALSE;
+
+    if (!core->libraries || !core->libraries[core->next_library])
+        return FALSE;
+
+    close_component (core);
+
+    open_next (core);
+
+    return core->omx_error == OMX_ErrorNone;
+}
+
+/** The library the component came from. */
+const gchar *
+g_omx_core_get_library_name (GOmxCore *core)
+{
+    return core->handle ? core->handle->library_name : NULL;
+}
+
+/**
+ * Tells a component that can play several roles which one it plays.
+ * The component must be in Loaded.
+ */
+OMX_ERRORTYPE
+g_omx_core_set_role (GOmxCore *core,
+                     const gchar *role)
+{
+    OMX_PARAM_COMPONENTROLETYPE param;
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+    g_strlcpy ((gchar *) param.cRole, role, sizeof (param.cRole));
+
+    return OMX_SetParameter (core->omx_handle, OMX_IndexParamStandardComponentRole, &param);
+}
+
+void
+g_omx_core_deinit (GOmxCore *core)
+{
+    if (!core->imp)
+        return;
+
+    /* Only a clean component in Loaded can be handed to someone else;
+     * one that wants the same role, and gets the ports' defaults back. */
+    if (core->omx_error == OMX_ErrorNone &&
+        core->omx_state == OMX_StateLoaded &&
+        pool_put (core->handle))
+    {
+        core->handle = NULL;
+        core->omx_handle = NULL;
+        core->imp = NULL;
+        return;
+    }
+
+    core->omx_error = core->imp->sym_table.free_handle (core->omx_handle);
+
+    if (core->omx_error)
+        return;
+
+    release_imp (core->imp);
+    core->imp = NULL;
+
+    g_free (core->handle->library_name);
+    g_free (core->handle->component_name);
+    g_free (core->handle->role);
+    g_free (core->handle->defaults);
+    g_free (core->handle);
+    core->handle = NULL;
+}
+
+void
+g_omx_core_prepare (GOmxCore *core)
+{
+    GOmxStateChange *change;
+
+    change = g_omx_core_prepare_async (core);
+
+    wait_for_state (core, change->state);
+
+    g_omx_state_change_free (change);
+}
+
+/**
+ * Starts the transition to Idle and hands the buffers to the component, but
+ * doesn't wait for it to be done with them.
+ */
+GOmxStateChange *
+g_omx_core_prepare_async (GOmxCore *core)
+{
+    GOmxStateChange *change;
+
+    change = g_omx_core_request_state (core, OMX_StateIdle);
+
+    /* Allocate buffers. */
+    {
+        OMX_ERRORTYPE error = OMX_ErrorNone;
+        guint index;
+
+        for (index = 0; index < core->ports->len && error == OMX_ErrorNone; index++)
+        {
+            GOmxPort *port;
+
+            port = g_omx_core_get_port (core, index);
+
+            if (port)
+                error = port_alloc_buffers (core, port, index);
+        }
+
+        /* Idle won't come without the buffers; take back the ones that
+         * made it, and fail whoever waits for it. */
+        if (error != OMX_ErrorNone)
+        {
+            for (index = 0; index < core->ports->len; index++)
+            {
+                GOmxPort *port;
+
+                port = g_omx_core_get_port (core, index);
+
+                if (port)
+                    port_free_buffers (core, port, index);
+            }
+
+            OMX_SendCommand (core->omx_handle, OMX_CommandStateSet, OMX_StateLoaded, NULL);
+
+            core->omx_error = error;
+
+            g_mutex_lock (core->state_mutex);
+            core->state_error = error;
+            g_cond_broadcast (core->state_cond);
+            g_mutex_unlock (core->state_mutex);
+        }
+    }
+
+    return change;
+}
+
+/**
+ * Asks the component to go to state. The result has to be freed with
+ * g_omx_state_change_free(), whether it was waited for or not.
+ */
+GOmxStateChange *
+g_omx_core_request_state (GOmxCore *core,
+                          OMX_STATETYPE state)
+{
+    GOmxStateChange *change;
+
+    change = g_new (GOmxStateChange, 1);
+    change->core = core;
+    change->state = state;
+
+    change_state (core, state);
+
+    return change;
+}
+
+void
+g_omx_core_get_state_stats (GOmxCore *core,
+                            WaitStats *waits)
+{
+    g_mutex_lock (core->state_mutex);
+    *waits = core->state_waits;
+    g_mutex_unlock (core->state_mutex);
+}
+
+/*
+ * State changes
+ */
+
+gboolean
+g_omx_state_change_is_done (GOmxStateChange *change)
+{
+    return state_reached (change->core, change->state, 0);
+}
+
+/**
+ * Waits up to timeout microseconds (forever if 0) for the component to
+ * report the requested state. Returns FALSE on timeout, or if the component
+ * reported an error meanwhile; see state_error.
+ */
+gboolean
+g_omx_state_change_wait (GOmxStateChange *change,
+                         gulong timeout)
+{
+    GOmxCore *core;
+
+    core = change->core;
+
+    if (!state_reached (core, change->state, timeout ? timeout : G_MAXULONG))
+    {
+        core->omx_error = core->state_error ? core->state_error : OMX_ErrorTimeout;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void
+g_omx_state_change_free (GOmxStateChange *change)
+{
+    g_free (change);
+}
+
+void
+g_omx_core_start (GOmxCore *core)
+{
+    g_atomic_int_set (&core->eos_owed, FALSE);
+
+    change_state (core, OMX_StateExecuting);
+
+    wait_for_state (core, OMX_StateExecuting);
+
+    {
+        guint index;
+        guint i;
+
+        for (index = 0; index < core->ports->len; index++)
+        {
+            GOmxPort *port;
+
+            port = g_omx_core_get_port (core, index);
+
+            for (i = 0; i < port->num_buffers; i++)
+            {
+                OMX_BUFFERHEADERTYPE *omx_buffer;
+
+                omx_buffer = port->buffers[i];
+
+                got_buffer (core, port, omx_buffer);
+            }
+        }
+    }
+
+    watchdog_start (core);
+}
+
+void
+g_omx_core_pause (GOmxCore *core)
+{
+    change_state (core, OMX_StatePause);
+
+    wait_for_state (core, OMX_StatePause);
+}
+
+void
+g_omx_core_finish (GOmxCore *core)
+{
+    watchdog_stop (core);
+
+    change_state (core, OMX_StateIdle);
+
+    wait_for_state (core, OMX_StateIdle);
+
+    change_state (core, OMX_StateLoaded);
+
+    {
+        guint index;
+
+        for (index = 0; index < core->ports->len; index++)
+        {
+            GOmxPort *port;
+
+            port = g_omx_core_get_port (core, index);
+
+            port_free_buffers (core, port, index);
+        }
+    }
+
+    wait_for_state (core, OMX_StateLoaded);
+
+    {
+        guint index;
+        for (index = 0; index < core->ports->len; index++)
+        {
+            GOmxPort *port;
+            port = g_omx_core_get_port (core, index);
+            g_omx_port_free (port);
+        }
+        g_ptr_array_clear (core->ports);
+    }
+}
+
+/** Decides how many buffers the port gets this time. */
+static guint
+choose_count (GOmxBufferCount *count,
+              OMX_PARAM_PORTDEFINITIONTYPE *omx_port)
+{
+    guint min;
+    guint n;
+
+    min = MAX (omx_port->nBufferCountMin, 1);
+
+    if (count->wanted == GOMX_BUFFERS_AUTO)
+    {
+        n = count->count ? count->count : omx_port->nBufferCountActual;
+
+        if (count->grow)
+            n = MIN (n * 2, MAX (min * AUTO_BUFFERS_FACTOR, n));
+    }
+    else if (count->wanted == 0)
+    {
+        n = omx_port->nBufferCountActual;
+    }
+    else
+    {
+        n = count->wanted;
+    }
+
+    n = MAX (n, min);
+
+    count->count = n;
+    count->grow = FALSE;
+
+    return n;
+}
+
+/**
+ * Like g_omx_core_setup_port(), but the port gets as many buffers as count
+ * says; the component is told through nBufferCountActual.
+ */
+GOmxPort *
+g_omx_core_setup_port_count (GOmxCore *core,
+                             OMX_PARAM_PORTDEFINITIONTYPE *omx_port,
+                             GOmxBufferCount *count)
+{
+    GOmxPort *port;
+    guint n;
+
+    n = choose_count (count, omx_port);
+
+    if (n != omx_port->nBufferCountActual)
+    {
+        omx_port->nBufferCountActual = n;
+        OMX_SetParameter (core->omx_handle, OMX_IndexParamPortDefinition, omx_port);
+    }
+
+    port = g_omx_core_setup_port (core, omx_port);
+
+    port->count = count;
+    port->warmup_pops = 0;
+    port->warmup_waits = 0;
+    g_atomic_int_set (&port->warming_up,
+                      count->wanted == GOMX_BUFFERS_AUTO ? WARMUP_IDLE : WARMUP_DONE);
+
+    return port;
+}
+
+GOmxPort *
+g_omx_core_setup_port (GOmxCore *core,
+                       OMX_PARAM_PORTDEFINITIONTYPE *omx_port)
+{
+    GOmxPort *port;
+    guint index;
+
+    index = omx_port->nPortIndex;
+    port = g_omx_core_get_port (core, index);
+
+    if (!port)
+    {
+        port = g_omx_port_new (core);
+    }
+
+    g_omx_port_setup (port, omx_port);
+
+    /* The watchdog walks the ports. */
+    g_mutex_lock (core->state_mutex);
     g_ptr_array_insert (core->ports, index, port);
+    g_mutex_unlock (core->state_mutex);
 
     return port;
 }
 
+/**
+ * Sets how long the ports and semaphores of core busy-wait before sleeping;
+ * see async_queue_set_spin().
+ */
+void
+g_omx_core_set_spin (GOmxCore *core,
+                     guint spin)
+{
+    guint index;
+
+    core->spin = spin;
+
+    g_omx_sem_set_spin (core->done_sem, spin);
+    g_omx_sem_set_spin (core->flush_sem, spin);
+
+    for (index = 0; index < core->ports->len; index++)
+    {
+        GOmxPort *port;
+
+        port = g_omx_core_get_port (core, index);
+
+        if (port)
+            g_omx_port_set_spin (port, spin);
+    }
+}
+
 inline GOmxPort *
 g_omx_core_get_port (GOmxCore *core,
                      guint index)
@@ -423,15 +1514,270 @@ g_omx_core_set_done (GOmxCore *core)
     g_omx_sem_up (core->done_sem);
 }
 
-void
-g_omx_core_wait_for_done (GOmxCore *core)
-{
-    g_omx_sem_down (core->done_sem);
+/**
+ * Returns FALSE if the core has a timeout and the component didn't finish
+ * within it.
+ */
+gboolean
+g_omx_core_wait_for_done (GOmxCore *core)
+{
+    if (!core->timeout)
+    {
+        g_omx_sem_down (core->done_sem);
+        return TRUE;
+    }
+
+    return g_omx_sem_down_timed (core->done_sem, core->timeout);
+}
+
+/*
+ * Port
+ */
+
+/**
+ * Allocates the data of all the buffers in one go, each one aligned to what
+ * the component asked for, and at least to SLAB_ALIGNMENT. The buffers are
+ * next to each other, so contiguity comes for free. Touching every page
+ * now saves the first frames from the page faults. Returns the distance
+ * between buffers.
+ */
+static gsize
+port_alloc_slab (GOmxPort *port,
+                 gboolean prefault)
+{
+    gsize alignment;
+    gsize stride;
+    gsize page_size;
+
+    alignment = SLAB_ALIGNMENT;
+    while (alignment < port->alignment)
+        alignment <<= 1;
+
+    stride = (port->buffer_size + alignment - 1) & ~(alignment - 1);
+    page_size = sysconf (_SC_PAGESIZE);
+
+    free (port->slab);
+    port->slab = NULL;
+    port->slab_size = stride * port->num_buffers;
+
+    if (posix_memalign (&port->slab, MAX (alignment, page_size), MAX (port->slab_size, 1)) != 0)
+        g_error ("couldn't allocate %lu bytes\n", (gulong) port->slab_size);
+
+    if (prefault)
+    {
+        gsize offset;
+
+        for (offset = 0; offset < port->slab_size; offset += page_size)
+            ((volatile guint8 *) port->slab)[offset] = 0;
+    }
+
+    return stride;
+}
+
+/**
+ * Hands the port's buffers to the component. In auto mode the component
+ * gets to allocate them, unless it refuses the first one. If any buffer
+ * can't be set up, the ones that were go back, and the error is returned.
+ */
+static OMX_ERRORTYPE
+port_alloc_buffers (GOmxCore *core,
+                    GOmxPort *port,
+                    guint index)
+{
+    OMX_ERRORTYPE error = OMX_ErrorNone;
+    guint i;
+
+    port->allocated = FALSE;
+
+    if (port->allocation != GOMX_ALLOCATION_USE)
+    {
+        error = OMX_AllocateBuffer (core->omx_handle,
+                                    &port->buffers[0],
+                                    index,
+                                    NULL,
+                                    port->buffer_size);
+
+        if (error == OMX_ErrorNone)
+        {
+            port->allocated = TRUE;
+
+            for (i = 1; i < port->num_buffers; i++)
+            {
+                error = OMX_AllocateBuffer (core->omx_handle,
+                                            &port->buffers[i],
+                                            index,
+                                            NULL,
+                                            port->buffer_size);
+
+                if (error != OMX_ErrorNone)
+                {
+                    port->buffers[i] = NULL;
+                    break;
+                }
+            }
+
+            goto leave;
+        }
+
+        port->buffers[0] = NULL;
+
+        if (port->allocation == GOMX_ALLOCATION_ALLOCATE)
+            goto leave;
+    }
+
+    {
+        gsize stride;
+
+        stride = port_alloc_slab (port, core->prefault);
+        port->stride = stride;
+
+        for (i = 0; i < port->num_buffers; i++)
+        {
+            error = OMX_UseBuffer (core->omx_handle,
+                                   &port->buffers[i],
+                                   index,
+                                   NULL,
+                                   port->buffer_size,
+                                   (guint8 *) port->slab + i * stride);
+
+            if (error != OMX_ErrorNone)
+            {
+                port->buffers[i] = NULL;
+                break;
+            }
+        }
+    }
+
+leave:
+    if (error != OMX_ErrorNone)
+    {
+        g_warning ("couldn't set up buffers on port %u: 0x%x", index, error);
+        port_free_buffers (core, port, index);
+    }
+
+    return error;
+}
+
+/**
+ * Gives omx_buffer its own data back, if it was carrying borrowed data,
+ * and lets the owner of that go.
+ */
+static void
+port_return_data (GOmxPort *port,
+                  OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    gpointer owner;
+    guint i;
+
+    if (!port->borrow_notify || !omx_buffer->pAppPrivate)
+        return;
+
+    for (i = 0; i < port->num_buffers; i++)
+    {
+        if (port->buffers[i] == omx_buffer)
+            break;
+    }
+
+    owner = omx_buffer->pAppPrivate;
+    omx_buffer->pAppPrivate = NULL;
+    omx_buffer->pBuffer = (guint8 *) port->slab + i * port->stride;
+    omx_buffer->nAllocLen = port->buffer_size;
+
+    port->borrow_notify (owner);
+}
+
+static void
+port_free_buffers (GOmxCore *core,
+                   GOmxPort *port,
+                   guint index)
+{
+    guint i;
+
+    /* Lent buffers go too; their data stays in the slab until they come
+     * back, and then nobody hands them to the component anymore. */
+    g_mutex_lock (port->mutex);
+    port->orphaned = TRUE;
+
+    while (port->returning)
+        g_cond_wait (port->cond, port->mutex);
+
+    for (i = 0; i < port->num_buffers; i++)
+    {
+        OMX_BUFFERHEADERTYPE *omx_buffer;
+
+        omx_buffer = port->buffers[i];
+        if (!omx_buffer)
+            continue;
+
+        port_return_data (port, omx_buffer);
+        g_omx_port_free_buffer_data (port, omx_buffer);
+
+        OMX_FreeBuffer (core->omx_handle, index, omx_buffer);
+        port->buffers[i] = NULL;
+    }
+
+    g_mutex_unlock (port->mutex);
+}
+
+/**
+ * Frees the data of omx_buffer, unless it's part of the port's slab; the
+ * elements may have given the buffer data of their own. Data the component
+ * allocated stays where it is; it goes with OMX_FreeBuffer.
+ */
+void
+g_omx_port_free_buffer_data (GOmxPort *port,
+                             OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    guint8 *data;
+
+    if (port->allocated)
+        return;
+
+    data = omx_buffer->pBuffer;
+
+    if (!port->slab ||
+        data < (guint8 *) port->slab ||
+        data >= (guint8 *) port->slab + port->slab_size)
+    {
+        g_free (data);
+    }
+
+    omx_buffer->pBuffer = NULL;
 }
 
-/*
- * Port
+/**
+ * Has omx_buffer carry data that isn't the port's, e.g. that of an upstream
+ * buffer, instead of a copy of it. Once the component is done with
+ * omx_buffer, notify is called with owner, from the component's thread,
+ * and omx_buffer gets its own data back. Returns FALSE if the data doesn't
+ * suit the port: the component owns the data of the buffers, or the data
+ * is misaligned, or too big; it has to be copied then.
  */
+gboolean
+g_omx_port_borrow_data (GOmxPort *port,
+                        OMX_BUFFERHEADERTYPE *omx_buffer,
+                        gpointer data,
+                        gsize size,
+                        gpointer owner,
+                        GDestroyNotify notify)
+{
+    if (port->allocated || !port->slab ||
+        size > port->buffer_size ||
+        (port->alignment > 1 && GPOINTER_TO_SIZE (data) % port->alignment != 0))
+    {
+        return FALSE;
+    }
+
+    port->borrow_notify = notify;
+
+    omx_buffer->pAppPrivate = owner;
+    omx_buffer->pBuffer = data;
+    omx_buffer->nAllocLen = size;
+    omx_buffer->nOffset = 0;
+    omx_buffer->nFilledLen = size;
+
+    return TRUE;
+}
 
 GOmxPort *
 g_omx_port_new (GOmxCore *core)
@@ -445,22 +1791,40 @@ g_omx_port_new (GOmxCore *core)
     port->buffers = NULL;
 
     port->enabled = TRUE;
-    port->queue = async_queue_new ();
     port->mutex = g_mutex_new ();
+    port->cond = g_cond_new ();
+    port->spin = core->spin;
+    port->ref_count = 1;
 
     return port;
 }
 
-void
-g_omx_port_free (GOmxPort *port)
+static void
+port_unref (GOmxPort *port)
 {
+    if (!g_atomic_int_dec_and_test (&port->ref_count))
+        return;
+
+    free (port->slab);
+    g_cond_free (port->cond);
     g_mutex_free (port->mutex);
-    async_queue_free (port->queue);
+    if (port->queue)
+        async_queue_free (port->queue);
 
     g_free (port->buffers);
     g_free (port);
 }
 
+/**
+ * The core is done with port; it goes away once the buffers lent from it
+ * are back.
+ */
+void
+g_omx_port_free (GOmxPort *port)
+{
+    port_unref (port);
+}
+
 void
 g_omx_port_setup (GOmxPort *port,
                   OMX_PARAM_PORTDEFINITIONTYPE *omx_port)
@@ -480,15 +1844,26 @@ g_omx_port_setup (GOmxPort *port,
     }
 
     port->type = type;
-    port->num_buffers = omx_port->nBufferCountMin;
+    port->num_buffers = MAX (omx_port->nBufferCountActual, omx_port->nBufferCountMin);
     port->buffer_size = omx_port->nBufferSize;
+    port->alignment = omx_port->nBufferAlignment;
+    port->contiguous = omx_port->bBuffersContiguous;
 
     if (port->buffers)
     {
         /** @todo handle this case */
         g_print ("WARNING: unhandled setup\n");
     }
-    port->buffers = g_new (OMX_BUFFERHEADERTYPE *, port->num_buffers);
+    port->buffers = g_new0 (OMX_BUFFERHEADERTYPE *, port->num_buffers);
+
+    /* There is one producer (the component callbacks) and one consumer
+     * (the element's streaming thread), and never more than num_buffers
+     * buffers in flight. */
+    if (port->queue)
+        async_queue_free (port->queue);
+    port->queue = async_queue_new_bounded (port->num_buffers);
+    async_queue_set_spin (port->queue, port->spin);
+    g_omx_port_set_watermarks (port, port->low_watermark, port->high_watermark);
 }
 
 void
@@ -504,13 +1879,99 @@ g_omx_port_request_buffer (GOmxPort *port)
     return async_queue_pop (port->queue);
 }
 
+OMX_BUFFERHEADERTYPE *
+g_omx_port_request_buffer_timed (GOmxPort *port,
+                                 gulong timeout)
+{
+    return async_queue_pop_timed (port->queue, timeout);
+}
+
+guint
+g_omx_port_request_buffers (GOmxPort *port,
+                            OMX_BUFFERHEADERTYPE **buffers,
+                            guint max)
+{
+    return async_queue_pop_many (port->queue, (gpointer *) buffers, max);
+}
+
+/**
+ * Like g_omx_port_request_buffers() but never blocks; meant to be called
+ * when the descriptor from g_omx_port_get_fd() is readable.
+ */
+guint
+g_omx_port_try_request_buffers (GOmxPort *port,
+                                OMX_BUFFERHEADERTYPE **buffers,
+                                guint max)
+{
+    return async_queue_try_pop_many (port->queue, (gpointer *) buffers, max);
+}
+
+gint
+g_omx_port_get_fd (GOmxPort *port)
+{
+    return async_queue_get_fd (port->queue);
+}
+
+/**
+ * Watches how often the consumer of the port had to wait for a buffer, and
+ * if it's too often, has the port grow the next time it's set up; it
+ * can't while the component has the buffers.
+ *
+ * Lent buffers come back from any thread, so only one caller at a time
+ * gets to look: it swaps warming_up from WARMUP_IDLE to WARMUP_BUSY, and
+ * the others skip this release.
+ */
+static void
+port_warm_up (GOmxPort *port)
+{
+    AsyncQueueStats stats;
+    guint pops;
+    guint waits;
+    gint next = WARMUP_IDLE;
+
+    if (!g_atomic_int_compare_and_exchange (&port->warming_up, WARMUP_IDLE, WARMUP_BUSY))
+        return;
+
+    g_omx_port_get_stats (port, &stats);
+
+    /* The first round always waits for the component to get going. */
+    if (!port->warmup_pops)
+    {
+        if (stats.pops >= port->num_buffers)
+        {
+            port->warmup_pops = stats.pops;
+            port->warmup_waits = stats.waits.count;
+        }
+        goto leave;
+    }
+
+    pops = stats.pops - port->warmup_pops;
+    waits = stats.waits.count - port->warmup_waits;
+
+    if (pops < WARMUP_POPS)
+        goto leave;
+
+    port->count->grow = (waits * STARVING_RATIO > pops);
+    next = WARMUP_DONE;
+
+leave:
+    g_atomic_int_set (&port->warming_up, next);
+}
+
 void
 g_omx_port_release_buffer (GOmxPort *port,
                            OMX_BUFFERHEADERTYPE *omx_buffer)
 {
+    if (G_UNLIKELY (g_atomic_int_get (&port->warming_up) != WARMUP_DONE))
+        port_warm_up (port);
+
+    g_atomic_int_inc (&port->component_buffers);
+
     switch (port->type)
     {
         case GOMX_PORT_INPUT:
+            if (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)
+                g_atomic_int_set (&port->core->eos_owed, TRUE);
             OMX_EmptyThisBuffer (port->core->omx_handle, omx_buffer);
             break;
         case GOMX_PORT_OUTPUT:
@@ -521,6 +1982,73 @@ g_omx_port_release_buffer (GOmxPort *port,
     }
 }
 
+/**
+ * Lets omx_buffer, just taken from the port, be held outside for as long as
+ * it takes, e.g. by a downstream element; g_omx_port_return_buffer() gives
+ * it back. Only data from the port's slab is lent, since the component may
+ * free data of its own under it; and never the last buffer the component
+ * would have, so whoever holds them can't stall it. Returns FALSE if
+ * omx_buffer can't be lent; it's still the caller's to release then.
+ */
+gboolean
+g_omx_port_lend_buffer (GOmxPort *port,
+                        OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    gboolean ret = FALSE;
+
+    g_mutex_lock (port->mutex);
+
+    if (!port->allocated && port->slab && port->enabled &&
+        port->lent + 1 < port->num_buffers)
+    {
+        port->lent++;
+        g_atomic_int_inc (&port->ref_count);
+        ret = TRUE;
+    }
+
+    g_mutex_unlock (port->mutex);
+
+    return ret;
+}
+
+/**
+ * Gives back a buffer lent with g_omx_port_lend_buffer(); it goes straight
+ * to the component, unless the port is finished, or its buffers freed in
+ * the meantime. May be called from any thread; port may be gone after it.
+ */
+void
+g_omx_port_return_buffer (GOmxPort *port,
+                          OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    gboolean release;
+
+    g_mutex_lock (port->mutex);
+
+    port->lent--;
+
+    release = (!port->orphaned && port->enabled);
+    if (release)
+        port->returning++;
+
+    g_mutex_unlock (port->mutex);
+
+    /* Not under the lock; a component may fill the buffer right away, and
+     * the port lend it out again from inside the call. port_free_buffers
+     * waits for us instead. */
+    if (release)
+    {
+        omx_buffer->nFilledLen = 0;
+        g_omx_port_release_buffer (port, omx_buffer);
+
+        g_mutex_lock (port->mutex);
+        if (--port->returning == 0)
+            g_cond_broadcast (port->cond);
+        g_mutex_unlock (port->mutex);
+    }
+
+    port_unref (port);
+}
+
 void
 g_omx_port_enable (GOmxPort *port)
 {
@@ -540,6 +2068,58 @@ g_omx_port_finish (GOmxPort *port)
     async_queue_disable (port->queue);
 }
 
+static void
+port_watermark (AsyncQueue *queue,
+                gboolean high,
+                gpointer data)
+{
+    GOmxPort *port;
+
+    port = data;
+    port->above_watermark = high;
+
+    if (port->watermark_cb)
+        port->watermark_cb (port);
+}
+
+/**
+ * watermark_cb is called when the number of buffers waiting on our side
+ * reaches high, and when it goes back down to low; above_watermark tells
+ * which one. It's called from the component's or the element's thread,
+ * after the port queue is unlocked, so it may post messages or read the
+ * port's statistics; calls never overlap.
+ */
+void
+g_omx_port_set_watermarks (GOmxPort *port,
+                           guint low,
+                           guint high)
+{
+    port->low_watermark = low;
+    port->high_watermark = high;
+    port->above_watermark = FALSE;
+
+    if (port->queue)
+        async_queue_set_watermarks (port->queue, low, high, port_watermark, port);
+}
+
+/** Statistics of the buffers waiting on our side of the port. */
+void
+g_omx_port_get_stats (GOmxPort *port,
+                      AsyncQueueStats *stats)
+{
+    async_queue_get_stats (port->queue, stats);
+}
+
+void
+g_omx_port_set_spin (GOmxPort *port,
+                     guint spin)
+{
+    port->spin = spin;
+
+    if (port->queue)
+        async_queue_set_spin (port->queue, spin);
+}
+
 /*
  * Semaphore
  */
@@ -549,10 +2129,11 @@ g_omx_sem_new (void)
 {
     GOmxSem *sem;
 
-    sem = g_new (GOmxSem, 1);
+    sem = g_new0 (GOmxSem, 1);
     sem->condition = g_cond_new ();
     sem->mutex = g_mutex_new ();
     sem->counter = 0;
+    spin_wait_init (&sem->spin, 0);
 
     return sem;
 }
@@ -565,18 +2146,105 @@ g_omx_sem_free (GOmxSem *sem)
     g_free (sem);
 }
 
+static gboolean
+sem_ready (gpointer data)
+{
+    GOmxSem *sem;
+
+    sem = data;
+
+    return g_atomic_int_get (&sem->counter) > 0;
+}
+
 void
 g_omx_sem_down (GOmxSem *sem)
 {
+    spin_wait (&sem->spin, sem_ready, sem);
+
     g_mutex_lock (sem->mutex);
 
-    while (sem->counter == 0)
+    if (sem->counter == 0)
     {
-        g_cond_wait (sem->condition, sem->mutex);
+        GTimeVal start;
+
+        g_get_current_time (&start);
+
+        while (sem->counter == 0)
+        {
+            g_cond_wait (sem->condition, sem->mutex);
+        }
+
+        wait_stats_add (&sem->stats.waits, &start);
     }
 
     sem->counter--;
+    sem->stats.downs++;
+
+    g_mutex_unlock (sem->mutex);
+}
+
+/**
+ * Returns FALSE if the semaphore couldn't be taken within timeout
+ * microseconds.
+ */
+gboolean
+g_omx_sem_down_timed (GOmxSem *sem,
+                      gulong timeout)
+{
+    GTimeVal start;
+    GTimeVal end_time;
+    gboolean ret = TRUE;
+
+    spin_wait (&sem->spin, sem_ready, sem);
+
+    g_get_current_time (&start);
+    end_time = start;
+    g_time_val_add (&end_time, timeout);
+
+    g_mutex_lock (sem->mutex);
+
+    if (sem->counter == 0)
+    {
+        while (sem->counter == 0)
+        {
+            if (!g_cond_timed_wait (sem->condition, sem->mutex, &end_time))
+            {
+                ret = (sem->counter > 0);
+                break;
+            }
+        }
+
+        wait_stats_add (&sem->stats.waits, &start);
+    }
+
+    if (ret)
+    {
+        sem->counter--;
+        sem->stats.downs++;
+    }
+    else
+    {
+        sem->stats.timeouts++;
+    }
+
+    g_mutex_unlock (sem->mutex);
+
+    return ret;
+}
 
+void
+g_omx_sem_set_spin (GOmxSem *sem,
+                    guint spin)
+{
+    spin_wait_init (&sem->spin, spin);
+}
+
+void
+g_omx_sem_get_stats (GOmxSem *sem,
+                     GOmxSemStats *stats)
+{
+    g_mutex_lock (sem->mutex);
+    *stats = sem->stats;
     g_mutex_unlock (sem->mutex);
 }
 
@@ -586,6 +2254,7 @@ g_omx_sem_up (GOmxSem *sem)
     g_mutex_lock (sem->mutex);
 
     sem->counter++;
+    sem->stats.ups++;
     g_cond_signal (sem->condition);
 
     g_mutex_unlock (sem->mutex);
@@ -599,14 +2268,222 @@ inline void
 change_state (GOmxCore *core,
               OMX_STATETYPE state)
 {
+    g_mutex_lock (core->state_mutex);
+    core->state_error = OMX_ErrorNone;
+    g_mutex_unlock (core->state_mutex);
+
     OMX_SendCommand (core->omx_handle, OMX_CommandStateSet, state, NULL);
 }
 
+/*
+ * Whether the component is in state, waiting up to timeout microseconds for
+ * it to get there; G_MAXULONG waits forever. An error reported by the
+ * component ends the wait early.
+ */
+static gboolean
+state_reached (GOmxCore *core,
+               OMX_STATETYPE state,
+               gulong timeout)
+{
+    gboolean ret;
+
+    g_mutex_lock (core->state_mutex);
+
+    if (timeout && core->omx_state != state && !core->state_error)
+    {
+        GTimeVal start;
+        GTimeVal end_time;
+
+        g_get_current_time (&start);
+        end_time = start;
+        if (timeout != G_MAXULONG)
+            g_time_val_add (&end_time, timeout);
+
+        while (core->omx_state != state && !core->state_error)
+        {
+            if (timeout == G_MAXULONG)
+                g_cond_wait (core->state_cond, core->state_mutex);
+            else if (!g_cond_timed_wait (core->state_cond, core->state_mutex, &end_time))
+                break;
+        }
+
+        wait_stats_add (&core->state_waits, &start);
+    }
+
+    ret = (core->omx_state == state);
+
+    g_mutex_unlock (core->state_mutex);
+
+    return ret;
+}
+
 inline void
 wait_for_state (GOmxCore *core,
                 OMX_STATETYPE state)
 {
-    g_omx_sem_down (core->state_sem);
+    GOmxStateChange change;
+
+    change.core = core;
+    change.state = state;
+
+    if (!g_omx_state_change_wait (&change, core->timeout))
+    {
+        g_warning ("failed waiting for state %d: 0x%x\n", state, core->omx_error);
+    }
+}
+
+/*
+ * Watchdog
+ */
+
+/**
+ * Whether the component has work it should be getting on with: input to
+ * consume, or the output for an EOS. Output buffers alone don't count; the
+ * component holds on to those for as long as it has no input.
+ * Called with state_mutex held.
+ */
+static gboolean
+component_owes_work (GOmxCore *core)
+{
+    guint index;
+
+    if (g_atomic_int_get (&core->eos_owed))
+        return TRUE;
+
+    for (index = 0; index < core->ports->len; index++)
+    {
+        GOmxPort *port;
+
+        port = g_omx_core_get_port (core, index);
+
+        if (port && port->type == GOMX_PORT_INPUT &&
+            g_atomic_int_get (&port->component_buffers) > 0)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Doesn't use flush_sem: a completion arriving after we gave up would
+ * otherwise be taken by the next FLUSH_STOP. The event handler counts
+ * completions against resets_sent first, so late ones end up here. */
+static void
+reset_component (GOmxCore *core)
+{
+    guint target;
+    GTimeVal end_time;
+    gboolean done = TRUE;
+
+    g_mutex_lock (core->state_mutex);
+    target = ++core->resets_sent;
+    g_mutex_unlock (core->state_mutex);
+
+    OMX_SendCommand (core->omx_handle, OMX_CommandFlush, OMX_ALL, NULL);
+
+    g_get_current_time (&end_time);
+    g_time_val_add (&end_time, core->timeout);
+
+    g_mutex_lock (core->state_mutex);
+    while (done && core->resets_done < target)
+    {
+        if (core->timeout)
+            done = g_cond_timed_wait (core->state_cond, core->state_mutex, &end_time);
+        else
+            g_cond_wait (core->state_cond, core->state_mutex);
+    }
+    g_mutex_unlock (core->state_mutex);
+
+    if (!done)
+        g_warning ("component didn't flush");
+}
+
+static gpointer
+watchdog_thread (gpointer data)
+{
+    GOmxCore *core;
+    gint last_count;
+    gboolean stalled = FALSE;
+
+    core = data;
+    last_count = g_atomic_int_get (&core->buffer_count);
+
+    g_mutex_lock (core->watchdog_mutex);
+
+    while (core->watchdog_running)
+    {
+        GTimeVal end_time;
+        gint count;
+        gboolean waiting;
+
+        g_get_current_time (&end_time);
+        g_time_val_add (&end_time, core->timeout);
+
+        if (g_cond_timed_wait (core->watchdog_cond, core->watchdog_mutex, &end_time))
+            continue;
+
+        count = g_atomic_int_get (&core->buffer_count);
+
+        if (count != last_count)
+        {
+            last_count = count;
+            stalled = FALSE;
+            continue;
+        }
+
+        /* Only complain once per stall, and only when we are actually
+         * waiting for the component. */
+        if (stalled)
+            continue;
+
+        g_mutex_lock (core->state_mutex);
+        waiting = (core->omx_state == OMX_StateExecuting &&
+                   component_owes_work (core));
+        g_mutex_unlock (core->state_mutex);
+
+        if (!waiting)
+            continue;
+
+        stalled = TRUE;
+
+        g_mutex_unlock (core->watchdog_mutex);
+
+        if (core->stalled_cb)
+            core->stalled_cb (core);
+
+        if (core->reset_on_stall)
+            reset_component (core);
+
+        g_mutex_lock (core->watchdog_mutex);
+    }
+
+    g_mutex_unlock (core->watchdog_mutex);
+
+    return NULL;
+}
+
+static void
+watchdog_start (GOmxCore *core)
+{
+    if (!core->timeout || core->watchdog)
+        return;
+
+    core->watchdog_running = TRUE;
+    core->watchdog = g_thread_create (watchdog_thread, core, TRUE, NULL);
+}
+
+static void
+watchdog_stop (GOmxCore *core)
+{
+    if (!core->watchdog)
+        return;
+
+    g_mutex_lock (core->watchdog_mutex);
+    core->watchdog_running = FALSE;
+    g_cond_signal (core->watchdog_cond);
+    g_mutex_unlock (core->watchdog_mutex);
+
+    g_thread_join (core->watchdog);
+    core->watchdog = NULL;
 }
 
 /*
@@ -653,6 +2530,10 @@ got_buffer (GOmxCore *core,
 
     if (G_LIKELY (port))
     {
+        /* Handled right here, in whatever thread the component called from. */
+        if (port->direct_cb && port->direct_cb (port, omx_buffer))
+            return;
+
         g_omx_port_push_buffer (port, omx_buffer);
 
         switch (port->type)
@@ -683,7 +2564,11 @@ EventHandler (OMX_HANDLETYPE omx_handle,
 {
     GOmxCore *core;
 
-    core = (GOmxCore *) app_data;
+    core = ((GOmxHandle *) app_data)->core;
+
+    /* Pooled; nobody is listening. */
+    if (!core)
+        return OMX_ErrorNone;
 
     switch (eEvent)
     {
@@ -696,10 +2581,24 @@ EventHandler (OMX_HANDLETYPE omx_handle,
                 switch (cmd)
                 {
                     case OMX_CommandStateSet:
+                        g_mutex_lock (core->state_mutex);
                         core->omx_state = (OMX_STATETYPE) nData2;
-                        g_omx_sem_up (core->state_sem);
+                        g_cond_broadcast (core->state_cond);
+                        g_mutex_unlock (core->state_mutex);
                         break;
                     case OMX_CommandFlush:
+                        /* Whatever EOS was in there is gone. */
+                        g_atomic_int_set (&core->eos_owed, FALSE);
+
+                        g_mutex_lock (core->state_mutex);
+                        if (core->resets_done < core->resets_sent)
+                        {
+                            core->resets_done++;
+                            g_cond_broadcast (core->state_cond);
+                            g_mutex_unlock (core->state_mutex);
+                            break;
+                        }
+                        g_mutex_unlock (core->state_mutex);
                         g_omx_sem_up (core->flush_sem);
                         break;
                     default:
@@ -707,6 +2606,15 @@ EventHandler (OMX_HANDLETYPE omx_handle,
                 }
                 break;
             }
+        case OMX_EventError:
+            {
+                /* Don't leave anyone waiting for a state that won't come. */
+                g_mutex_lock (core->state_mutex);
+                core->state_error = (OMX_ERRORTYPE) nData1;
+                g_cond_broadcast (core->state_cond);
+                g_mutex_unlock (core->state_mutex);
+                break;
+            }
         case OMX_EventBufferFlag:
             {
 #if 0
@@ -740,9 +2648,19 @@ EmptyBufferDone (OMX_HANDLETYPE omx_handle,
     GOmxCore *core;
     GOmxPort *port;
 
-    core = (GOmxCore*) app_data;
+    core = ((GOmxHandle *) app_data)->core;
     port = g_omx_core_get_port (core, omx_buffer->nInputPortIndex);
 
+    g_atomic_int_inc (&core->buffer_count);
+    if (G_LIKELY (port))
+    {
+        g_atomic_int_add (&port->component_buffers, -1);
+        port_return_data (port, omx_buffer);
+
+        if (port->done_cb)
+            port->done_cb (port, omx_buffer);
+    }
+
     got_buffer (core, port, omx_buffer);
 
     return OMX_ErrorNone;
@@ -756,9 +2674,21 @@ FillBufferDone (OMX_HANDLETYPE omx_handle,
     GOmxCore *core;
     GOmxPort *port;
 
-    core = (GOmxCore *) app_data;
+    core = ((GOmxHandle *) app_data)->core;
     port = g_omx_core_get_port (core, omx_buffer->nOutputPortIndex);
 
+    g_atomic_int_inc (&core->buffer_count);
+    if (G_LIKELY (port))
+    {
+        g_atomic_int_add (&port->component_buffers, -1);
+
+        if (port->done_cb)
+            port->done_cb (port, omx_buffer);
+    }
+
+    if (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)
+        g_atomic_int_set (&core->eos_owed, FALSE);
+
     got_buffer (core, port, omx_buffer);
 
     return OMX_ErrorNone;
@@ -29,18 +29,26 @@
 #include <OMX_Component.h>
 
 #include <async_queue.h>
+#include <dispatcher.h>
 
 /* Typedefs. */
 
 typedef struct GOmxCore GOmxCore;
 typedef struct GOmxPort GOmxPort;
 typedef struct GOmxSem GOmxSem;
+typedef struct GOmxSemStats GOmxSemStats;
+typedef struct GOmxStateChange GOmxStateChange;
 typedef struct GOmxImp GOmxImp;
+typedef struct GOmxHandle GOmxHandle;
 typedef struct GOmxSymbolTable GOmxSymbolTable;
 typedef enum GOmxPortType GOmxPortType;
+typedef enum GOmxAllocation GOmxAllocation;
+typedef struct GOmxBufferCount GOmxBufferCount;
 
 typedef void (*GOmxCb) (GOmxCore *core);
 typedef void (*GOmxPortCb) (GOmxPort *port);
+typedef gboolean (*GOmxBufferCb) (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
+typedef void (*GOmxBufferNotify) (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
 
 /* Enums. */
 
@@ -50,8 +58,29 @@ enum GOmxPortType
     GOMX_PORT_OUTPUT
 };
 
+/** Who provides the buffers' memory. */
+enum GOmxAllocation
+{
+    GOMX_ALLOCATION_USE, /**< We do; OMX_UseBuffer. */
+    GOMX_ALLOCATION_ALLOCATE, /**< The component does; OMX_AllocateBuffer. */
+    GOMX_ALLOCATION_AUTO /**< The component, if it's willing. */
+};
+
 /* Structures. */
 
+#define GOMX_BUFFERS_AUTO -1
+
+/**
+ * How many buffers a port gets. The element keeps this across
+ * reconfigurations; the port only lives until the next one.
+ */
+struct GOmxBufferCount
+{
+    gint wanted; /**< A count, 0 for the component's choice, or GOMX_BUFFERS_AUTO. */
+    guint count; /**< What the port got last time. */
+    gboolean grow; /**< Auto saw the port starve; it gets more next time. */
+};
+
 struct GOmxSymbolTable
 {
     OMX_ERRORTYPE (*init) (void);
@@ -61,6 +90,15 @@ struct GOmxSymbolTable
                                  OMX_PTR data,
                                  OMX_CALLBACKTYPE *callbacks);
     OMX_ERRORTYPE (*free_handle) (OMX_HANDLETYPE handle);
+    OMX_ERRORTYPE (*component_name_enum) (OMX_STRING name,
+                                          OMX_U32 length,
+                                          OMX_U32 index);
+    OMX_ERRORTYPE (*get_roles_of_component) (OMX_STRING name,
+                                             OMX_U32 *num_roles,
+                                             OMX_U8 **roles);
+    OMX_ERRORTYPE (*get_components_of_role) (OMX_STRING role,
+                                             OMX_U32 *num_components,
+                                             OMX_U8 **names);
 };
 
 struct GOmxImp
@@ -68,11 +106,17 @@ struct GOmxImp
     guint client_count;
     void *dl_handle;
     GOmxSymbolTable sym_table;
+
+    GMutex *mutex; /**< Serializes OMX_Init and OMX_Deinit. */
+    gboolean initialized;
+    gboolean lingering; /**< Unused, but not deinitialized yet. */
+    GTimeVal idle_since;
 };
 
 struct GOmxCore
 {
     OMX_HANDLETYPE omx_handle;
+    GOmxHandle *handle; /**< Owns omx_handle; it may outlive this core. */
     OMX_STATETYPE omx_state;
     OMX_ERRORTYPE omx_error;
 
@@ -80,7 +124,11 @@ struct GOmxCore
 
     gpointer client_data; /**< Placeholder for the client data. */
 
-    GOmxSem *state_sem;
+    GMutex *state_mutex;
+    GCond *state_cond; /**< Broadcast when omx_state or state_error change. */
+    OMX_ERRORTYPE state_error; /**< Error reported during the last transition. */
+    WaitStats state_waits;
+
     GOmxSem *done_sem;
     GOmxSem *flush_sem;
 
@@ -88,6 +136,27 @@ struct GOmxCore
     GOmxImp *imp;
 
     gboolean done;
+
+    gulong timeout; /**< Microseconds to wait for the component; 0 is forever. */
+    gboolean reset_on_stall; /**< Flush the component when it stalls. */
+    GOmxCb stalled_cb;
+    volatile gint buffer_count; /**< Buffers returned by the component. */
+    volatile gint eos_owed; /**< An EOS went in and hasn't come out yet. */
+
+    GThread *watchdog;
+    GMutex *watchdog_mutex;
+    GCond *watchdog_cond;
+    gboolean watchdog_running;
+    guint resets_sent; /**< Flushes sent by the watchdog; under state_mutex. */
+    guint resets_done; /**< Of those, the ones the component completed. */
+
+    guint spin; /**< Default spin for the ports and semaphores. */
+    gboolean prefault; /**< Touch the buffers' pages when allocating them. */
+
+    gchar **libraries; /**< Where to look for the component, in order. */
+    guint next_library; /**< The first one not tried yet. */
+    gchar *component_name;
+    gchar *role;
 };
 
 struct GOmxPort
@@ -98,10 +167,55 @@ struct GOmxPort
     guint num_buffers;
     gulong buffer_size;
     OMX_BUFFERHEADERTYPE **buffers;
+    GOmxBufferCount *count; /**< May be NULL. */
+    volatile gint warming_up; /**< Nonzero while watching for starvation; see port_warm_up. */
+    guint warmup_pops; /**< Only touched by whoever claimed warming_up. */
+    guint warmup_waits;
 
-    GMutex *mutex;
+    GOmxAllocation allocation;
+    gboolean allocated; /**< The component owns the buffers' data; don't touch pBuffer. */
+    guint alignment; /**< Of the buffers' data, as the component asked. */
+    gboolean contiguous;
+    gpointer slab; /**< Data of all the buffers. */
+    gsize slab_size;
+    gsize stride; /**< Between buffers in the slab. */
+    GDestroyNotify borrow_notify; /**< See g_omx_port_borrow_data. */
+
+    GMutex *mutex; /**< Protects lent, returning and orphaned. */
+    GCond *cond; /**< Signalled when returning drops to 0. */
     gboolean enabled;
     AsyncQueue *queue;
+
+    volatile gint ref_count; /**< One for the core, one for each lent buffer. */
+    guint lent; /**< Buffers held outside; see g_omx_port_lend_buffer. */
+    guint returning; /**< Lent buffers on their way back to the component. */
+    gboolean orphaned; /**< The buffers are freed; lent ones stay out. */
+
+    volatile gint component_buffers; /**< Buffers the component owns. */
+    guint spin;
+
+    guint low_watermark;
+    guint high_watermark; /**< Of buffers waiting in the queue; 0 disables. */
+    gboolean above_watermark;
+    GOmxPortCb watermark_cb;
+
+    GOmxBufferCb direct_cb; /**< Offered the buffers before they are queued; TRUE if it took them. */
+    GOmxBufferNotify done_cb; /**< Told about each buffer the component gives back, from its callback. */
+};
+
+/** A state transition that was requested, and may not have completed. */
+struct GOmxStateChange
+{
+    GOmxCore *core;
+    OMX_STATETYPE state;
+};
+
+struct GOmxSemStats
+{
+    guint ups;
+    guint downs;
+    guint timeouts;
+    WaitStats waits;
 };
 
 struct GOmxSem
@@ -109,38 +223,76 @@ struct GOmxSem
     GCond *condition;
     GMutex *mutex;
     gint counter;
+    SpinWait spin;
+    GOmxSemStats stats;
 };
 
 /* Functions. */
 
 void g_omx_init (void);
 void g_omx_deinit (void);
+Dispatcher *g_omx_get_dispatcher (void);
+void g_omx_set_handle_pool (guint max, guint idle);
+void g_omx_set_linger (guint seconds);
+void g_omx_preload (const gchar *const *library_names);
+void g_omx_preload_wait (void);
+GOmxImp *g_omx_request_imp (const gchar *library_name);
+void g_omx_release_imp (GOmxImp *imp);
+void g_omx_set_libraries (const gchar *const *library_names);
+gchar **g_omx_expand_libraries (const gchar *library_names);
 
 GOmxCore *g_omx_core_new (void);
 void g_omx_core_free (GOmxCore *core);
 void g_omx_core_init (GOmxCore *core, const gchar *library_name, const gchar *component_name);
+void g_omx_core_init_role (GOmxCore *core, const gchar *library_names, const gchar *component_name, const gchar *role);
+gboolean g_omx_core_failover (GOmxCore *core);
+const gchar *g_omx_core_get_library_name (GOmxCore *core);
 void g_omx_core_deinit (GOmxCore *core);
+OMX_ERRORTYPE g_omx_core_set_role (GOmxCore *core, const gchar *role);
 void g_omx_core_prepare (GOmxCore *core);
+GOmxStateChange *g_omx_core_prepare_async (GOmxCore *core);
+GOmxStateChange *g_omx_core_request_state (GOmxCore *core, OMX_STATETYPE state);
+void g_omx_core_get_state_stats (GOmxCore *core, WaitStats *waits);
 void g_omx_core_start (GOmxCore *core);
 void g_omx_core_pause (GOmxCore *core);
 void g_omx_core_finish (GOmxCore *core);
 void g_omx_core_set_done (GOmxCore *core);
-void g_omx_core_wait_for_done (GOmxCore *core);
+gboolean g_omx_core_wait_for_done (GOmxCore *core);
 GOmxPort *g_omx_core_setup_port (GOmxCore *core, OMX_PARAM_PORTDEFINITIONTYPE *omx_port);
+GOmxPort *g_omx_core_setup_port_count (GOmxCore *core, OMX_PARAM_PORTDEFINITIONTYPE *omx_port, GOmxBufferCount *count);
+void g_omx_core_set_spin (GOmxCore *core, guint spin);
+
+gboolean g_omx_state_change_is_done (GOmxStateChange *change);
+gboolean g_omx_state_change_wait (GOmxStateChange *change, gulong timeout);
+void g_omx_state_change_free (GOmxStateChange *change);
 
 GOmxPort *g_omx_port_new (GOmxCore *core);
 void g_omx_port_free (GOmxPort *port);
 void g_omx_port_setup (GOmxPort *port, OMX_PARAM_PORTDEFINITIONTYPE *omx_port);
 void g_omx_port_push_buffer (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
 OMX_BUFFERHEADERTYPE *g_omx_port_request_buffer (GOmxPort *port);
+OMX_BUFFERHEADERTYPE *g_omx_port_request_buffer_timed (GOmxPort *port, gulong timeout);
+guint g_omx_port_request_buffers (GOmxPort *port, OMX_BUFFERHEADERTYPE **buffers, guint max);
+guint g_omx_port_try_request_buffers (GOmxPort *port, OMX_BUFFERHEADERTYPE **buffers, guint max);
+gint g_omx_port_get_fd (GOmxPort *port);
 void g_omx_port_release_buffer (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
+gboolean g_omx_port_lend_buffer (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
+void g_omx_port_return_buffer (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
 void g_omx_port_enable (GOmxPort *port);
 void g_omx_port_disable (GOmxPort *port);
 void g_omx_port_finish (GOmxPort *port);
+void g_omx_port_set_spin (GOmxPort *port, guint spin);
+void g_omx_port_free_buffer_data (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
+gboolean g_omx_port_borrow_data (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer, gpointer data, gsize size, gpointer owner, GDestroyNotify notify);
+void g_omx_port_set_watermarks (GOmxPort *port, guint low, guint high);
+void g_omx_port_get_stats (GOmxPort *port, AsyncQueueStats *stats);
 
 GOmxSem *g_omx_sem_new (void);
 void g_omx_sem_free (GOmxSem *sem);
 void g_omx_sem_down (GOmxSem *sem);
+gboolean g_omx_sem_down_timed (GOmxSem *sem, gulong timeout);
 void g_omx_sem_up (GOmxSem *sem);
+void g_omx_sem_set_spin (GOmxSem *sem, guint spin);
+void g_omx_sem_get_stats (GOmxSem *sem, GOmxSemStats *stats);
 
 #endif /* GSTOMX_UTIL_H */
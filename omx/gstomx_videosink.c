@@ -26,8 +26,6 @@
 #include <string.h> /* For strcmp */
 #include <stdbool.h>
 
-#define OMX_COMPONENT_NAME "OMX.st.videosink"
-
 static GstOmxBaseSinkClass *parent_class = NULL;
 
 enum
@@ -344,8 +342,6 @@ type_instance_init (GTypeInstance *instance,
     omx_base = GST_OMX_BASE_SINK (instance);
 
     GST_DEBUG_OBJECT (omx_base, "start");
-
-    omx_base->omx_component = g_strdup (OMX_COMPONENT_NAME);
 }
 
 GType
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Round trip of a fixed set of buffers between two threads, the way OpenMAX
+ * buffer headers go back and forth between a port and the component.
+ */
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "async_queue.h"
+
+#define BUFFER_COUNT 4
+#define ROUND_TRIPS 0x100000
+
+typedef struct
+{
+    AsyncQueue *filled;
+    AsyncQueue *empty;
+} Ports;
+
+static gpointer
+component_func (gpointer data)
+{
+    Ports *ports;
+    guint i;
+
+    ports = data;
+    for (i = 0; i < ROUND_TRIPS; i++)
+    {
+        gpointer buffer;
+        buffer = async_queue_pop (ports->empty);
+        async_queue_push (ports->filled, buffer);
+    }
+
+    return NULL;
+}
+
+static void
+run (const gchar *name,
+     gboolean bounded)
+{
+    Ports ports;
+    GThread *thread;
+    GTimer *timer;
+    gdouble elapsed;
+    guint i;
+
+    if (bounded)
+    {
+        ports.filled = async_queue_new_bounded (BUFFER_COUNT);
+        ports.empty = async_queue_new_bounded (BUFFER_COUNT);
+    }
+    else
+    {
+        ports.filled = async_queue_new ();
+        ports.empty = async_queue_new ();
+    }
+
+    for (i = 0; i < BUFFER_COUNT; i++)
+        async_queue_push (ports.empty, GINT_TO_POINTER (i + 1));
+
+    timer = g_timer_new ();
+
+    thread = g_thread_create (component_func, &ports, TRUE, NULL);
+
+    for (i = 0; i < ROUND_TRIPS; i++)
+    {
+        gpointer buffer;
+        buffer = async_queue_pop (ports.filled);
+        async_queue_push (ports.empty, buffer);
+    }
+
+    g_thread_join (thread);
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    printf ("%-8s %u round trips in %.3f s (%.1f ns each)\n",
+            name, ROUND_TRIPS, elapsed, elapsed * 1e9 / ROUND_TRIPS);
+
+    async_queue_free (ports.filled);
+    async_queue_free (ports.empty);
+}
+
+int
+main (void)
+{
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    run ("list", FALSE);
+    run ("bounded", TRUE);
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Latency of the component alone, the way low-latency mode measures it: video
+ * frames are sent at a steady pace, each split over a few input buffers with
+ * OMX_BUFFERFLAG_ENDOFFRAME on the last one, to the stub component that only
+ * outputs whole frames. The time from EmptyThisBuffer of the last piece until
+ * FillBufferDone is measured, and compared against the frame interval.
+ *
+ * Usage: bench_latency [library]
+ * The library defaults to libomxil-foo.so from tests/standalone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gstomx_util.h"
+
+#define FRAME_COUNT 300
+#define FRAME_INTERVAL 33333 /* usec; 30 fps */
+#define FRAME_PARTS 4
+#define PART_SIZE 0x400
+#define BUCKET_COUNT 16
+#define COMPONENT_NAME "OMX.check.frames"
+
+static gdouble
+now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int
+compare_double (const void *a,
+                const void *b)
+{
+    gdouble x = *(const gdouble *) a;
+    gdouble y = *(const gdouble *) b;
+    return (x > y) - (x < y);
+}
+
+/* Set from FillBufferDone, read once the buffer is dequeued. */
+static gdouble done_time;
+
+static void
+output_done (GOmxPort *port,
+             OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    if (omx_buffer->nFilledLen > 0)
+        done_time = now ();
+}
+
+static gboolean
+run (const gchar *library)
+{
+    GOmxCore *core;
+    GOmxPort *in_port;
+    GOmxPort *out_port;
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+    gdouble *latency;
+    guint buckets[BUCKET_COUNT];
+    guint i;
+
+    core = g_omx_core_new ();
+    g_omx_core_init (core, library, COMPONENT_NAME);
+
+    if (core->omx_error)
+    {
+        g_omx_core_free (core);
+        return FALSE;
+    }
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+
+    param.nPortIndex = 0;
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+    in_port = g_omx_core_setup_port (core, &param);
+
+    param.nPortIndex = 1;
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+    out_port = g_omx_core_setup_port (core, &param);
+
+    out_port->done_cb = output_done;
+
+    g_omx_core_prepare (core);
+    g_omx_core_start (core);
+
+    /* The component gets the output buffers, like a filter does. */
+    g_omx_port_release_buffer (out_port, g_omx_port_request_buffer (out_port));
+
+    latency = g_new (gdouble, FRAME_COUNT);
+    memset (buckets, 0, sizeof (buckets));
+
+    for (i = 0; i < FRAME_COUNT; i++)
+    {
+        OMX_BUFFERHEADERTYPE *omx_buffer;
+        gdouble start = 0;
+        guint bucket;
+        guint part;
+
+        for (part = 0; part < FRAME_PARTS; part++)
+        {
+            omx_buffer = g_omx_port_request_buffer (in_port);
+            omx_buffer->nOffset = 0;
+            omx_buffer->nFilledLen = MIN (PART_SIZE, omx_buffer->nAllocLen);
+            omx_buffer->nTimeStamp = (OMX_TICKS) i * FRAME_INTERVAL;
+            omx_buffer->nFlags = 0;
+
+            if (part == FRAME_PARTS - 1)
+            {
+                omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+                start = now ();
+            }
+
+            g_omx_port_release_buffer (in_port, omx_buffer);
+        }
+
+        omx_buffer = g_omx_port_request_buffer (out_port);
+        latency[i] = done_time - start;
+
+        omx_buffer->nFilledLen = 0;
+        g_omx_port_release_buffer (out_port, omx_buffer);
+
+        /* Power of two buckets, in microseconds. */
+        for (bucket = 0;
+             bucket < BUCKET_COUNT - 1 && latency[i] >= (1 << bucket);
+             bucket++);
+        buckets[bucket]++;
+
+        usleep (FRAME_INTERVAL);
+    }
+
+    g_omx_port_finish (in_port);
+    g_omx_port_finish (out_port);
+
+    g_omx_core_finish (core);
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+
+    qsort (latency, FRAME_COUNT, sizeof (gdouble), compare_double);
+
+    printf ("median %.1f us, 90%% %.1f us, 99%% %.1f us, max %.1f us (frame interval %u us)\n",
+            latency[FRAME_COUNT / 2],
+            latency[FRAME_COUNT * 90 / 100],
+            latency[FRAME_COUNT * 99 / 100],
+            latency[FRAME_COUNT - 1],
+            FRAME_INTERVAL);
+
+    for (i = 0; i < BUCKET_COUNT; i++)
+    {
+        if (buckets[i])
+            printf ("  < %6u us: %u\n", 1 << i, buckets[i]);
+    }
+
+    g_free (latency);
+
+    return TRUE;
+}
+
+int
+main (int argc,
+      char **argv)
+{
+    const gchar *library;
+
+    library = argc > 1 ? argv[1] : "libomxil-foo.so";
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    g_omx_init ();
+
+    if (!run (library))
+    {
+        fprintf (stderr, "couldn't load %s\n", library);
+        return 1;
+    }
+
+    g_omx_deinit ();
+
+    return 0;
+}
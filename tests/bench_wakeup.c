@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Wakeup latency of the output port, with and without spinning, against the
+ * stub component: audio-like frames are sent at a steady pace, and the time
+ * from EmptyThisBuffer until the element has the output buffer in hand is
+ * measured.
+ *
+ * Usage: bench_wakeup [library] [spin-count]
+ * The library defaults to libomxil-foo.so from tests/standalone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gstomx_util.h"
+
+#define FRAME_COUNT 2000
+#define FRAME_INTERVAL 500 /* usec */
+#define FRAME_SIZE 160 /* 20 ms of G.711 */
+#define BUCKET_COUNT 16
+#define DEFAULT_SPIN 100000
+
+static gdouble
+now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int
+compare_double (const void *a,
+                const void *b)
+{
+    gdouble x = *(const gdouble *) a;
+    gdouble y = *(const gdouble *) b;
+    return (x > y) - (x < y);
+}
+
+static gboolean
+run (const gchar *library,
+     guint spin)
+{
+    GOmxCore *core;
+    GOmxPort *in_port;
+    GOmxPort *out_port;
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+    gdouble *latency;
+    guint buckets[BUCKET_COUNT];
+    guint i;
+
+    core = g_omx_core_new ();
+    g_omx_core_init (core, library, "OMX.foo.dummy");
+
+    if (core->omx_error)
+    {
+        g_omx_core_free (core);
+        return FALSE;
+    }
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+
+    param.nPortIndex = 0;
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+    in_port = g_omx_core_setup_port (core, &param);
+
+    param.nPortIndex = 1;
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+    out_port = g_omx_core_setup_port (core, &param);
+
+    g_omx_core_set_spin (core, spin);
+
+    g_omx_core_prepare (core);
+    g_omx_core_start (core);
+
+    latency = g_new (gdouble, FRAME_COUNT);
+    memset (buckets, 0, sizeof (buckets));
+
+    for (i = 0; i < FRAME_COUNT; i++)
+    {
+        OMX_BUFFERHEADERTYPE *omx_buffer;
+        gdouble start;
+        guint bucket;
+
+        omx_buffer = g_omx_port_request_buffer (in_port);
+        omx_buffer->nOffset = 0;
+        omx_buffer->nFilledLen = FRAME_SIZE;
+
+        start = now ();
+        g_omx_port_release_buffer (in_port, omx_buffer);
+
+        omx_buffer = g_omx_port_request_buffer (out_port);
+        latency[i] = now () - start;
+
+        omx_buffer->nFilledLen = 0;
+        g_omx_port_release_buffer (out_port, omx_buffer);
+
+        /* Power of two buckets, in microseconds. */
+        for (bucket = 0;
+             bucket < BUCKET_COUNT - 1 && latency[i] >= (1 << bucket);
+             bucket++);
+        buckets[bucket]++;
+
+        usleep (FRAME_INTERVAL);
+    }
+
+    g_omx_port_finish (in_port);
+    g_omx_port_finish (out_port);
+
+    g_omx_core_finish (core);
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+
+    qsort (latency, FRAME_COUNT, sizeof (gdouble), compare_double);
+
+    printf ("spin-count=%u: median %.1f us, 90%% %.1f us, 99%% %.1f us, max %.1f us\n",
+            spin,
+            latency[FRAME_COUNT / 2],
+            latency[FRAME_COUNT * 90 / 100],
+            latency[FRAME_COUNT * 99 / 100],
+            latency[FRAME_COUNT - 1]);
+
+    for (i = 0; i < BUCKET_COUNT; i++)
+    {
+        if (buckets[i])
+            printf ("  < %6u us: %u\n", 1 << i, buckets[i]);
+    }
+
+    g_free (latency);
+
+    return TRUE;
+}
+
+int
+main (int argc,
+      char **argv)
+{
+    const gchar *library;
+    guint spin;
+
+    library = argc > 1 ? argv[1] : "libomxil-foo.so";
+    spin = argc > 2 ? atoi (argv[2]) : DEFAULT_SPIN;
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    g_omx_init ();
+
+    if (!run (library, 0) ||
+        !run (library, spin))
+    {
+        fprintf (stderr, "couldn't load %s\n", library);
+        return 1;
+    }
+
+    g_omx_deinit ();
+
+    return 0;
+}
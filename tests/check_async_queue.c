@@ -24,6 +24,7 @@
 
 #define PROCESS_COUNT 0x1000
 #define DISABLE_AT PROCESS_COUNT / 2
+#define BOUNDED_SIZE 0x10
 
 START_TEST (test_async_queue_create)
 {
@@ -262,6 +263,395 @@ START_TEST (test_async_queue_enable)
 }
 END_TEST
 
+START_TEST (test_async_queue_bounded_process)
+{
+    AsyncQueue *queue;
+    gpointer foo;
+    guint i;
+    guint j;
+
+    queue = async_queue_new_bounded (BOUNDED_SIZE);
+    fail_if (!queue,
+             "Construction failed");
+
+    /* go around the ring a few times */
+    for (j = 0; j < 4; j++)
+    {
+        foo = GINT_TO_POINTER (1);
+        for (i = 0; i < BOUNDED_SIZE; i++, foo++)
+        {
+            async_queue_push (queue, foo);
+        }
+        foo = GINT_TO_POINTER (1);
+        for (i = 0; i < BOUNDED_SIZE; i++, foo++)
+        {
+            gpointer tmp;
+            tmp = async_queue_pop (queue);
+            fail_if (tmp != foo,
+                     "Pop failed");
+        }
+    }
+
+    fail_if (async_queue_pop_forced (queue) != NULL,
+             "Queue not empty");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+START_TEST (test_async_queue_bounded_threads)
+{
+    AsyncQueue *queue;
+    GThread *push_thread;
+    GThread *pop_thread;
+
+    queue = async_queue_new_bounded (PROCESS_COUNT);
+    fail_if (!queue,
+             "Construction failed");
+
+    pop_thread = g_thread_create (pop_func, queue, TRUE, NULL);
+    push_thread = g_thread_create (push_func, queue, TRUE, NULL);
+
+    g_thread_join (pop_thread);
+    g_thread_join (push_thread);
+
+    async_queue_free (queue);
+}
+END_TEST
+
+START_TEST (test_async_queue_bounded_disable)
+{
+    AsyncQueue *queue;
+    GThread *push_thread;
+    GThread *pop_thread;
+    guint count;
+
+    queue = async_queue_new_bounded (PROCESS_COUNT);
+    fail_if (!queue,
+             "Construction failed");
+
+    pop_thread = g_thread_create (pop_with_disable_func, queue, TRUE, NULL);
+
+    async_queue_disable (queue);
+
+    count = GPOINTER_TO_INT (g_thread_join (pop_thread));
+
+    fail_if (count != 0,
+             "Disable failed");
+
+    async_queue_enable (queue);
+
+    pop_thread = g_thread_create (pop_with_disable_func, queue, TRUE, NULL);
+    push_thread = g_thread_create (push_and_disable_func, queue, TRUE, NULL);
+
+    count = GPOINTER_TO_INT (g_thread_join (pop_thread));
+    g_thread_join (push_thread);
+
+    fail_if (count > DISABLE_AT,
+             "Disable failed");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+START_TEST (test_async_queue_spin)
+{
+    AsyncQueue *queue;
+    GThread *push_thread;
+    GThread *pop_thread;
+    guint count;
+
+    queue = async_queue_new_bounded (PROCESS_COUNT);
+    fail_if (!queue,
+             "Construction failed");
+
+    async_queue_set_spin (queue, 1000);
+
+    pop_thread = g_thread_create (pop_func, queue, TRUE, NULL);
+    push_thread = g_thread_create (push_func, queue, TRUE, NULL);
+
+    g_thread_join (pop_thread);
+    g_thread_join (push_thread);
+
+    /* spinning must not hide a disable */
+    pop_thread = g_thread_create (pop_with_disable_func, queue, TRUE, NULL);
+
+    async_queue_disable (queue);
+
+    count = GPOINTER_TO_INT (g_thread_join (pop_thread));
+
+    fail_if (count != 0,
+             "Disable failed");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+START_TEST (test_async_queue_pop_many)
+{
+    AsyncQueue *queue;
+    gpointer batch[BOUNDED_SIZE];
+    guint count;
+    guint i;
+
+    queue = async_queue_new_bounded (BOUNDED_SIZE);
+    fail_if (!queue,
+             "Construction failed");
+
+    for (i = 0; i < BOUNDED_SIZE / 2; i++)
+    {
+        async_queue_push (queue, GINT_TO_POINTER (i + 1));
+    }
+
+    count = async_queue_pop_many (queue, batch, BOUNDED_SIZE);
+    fail_if (count != BOUNDED_SIZE / 2,
+             "Pop many failed");
+    for (i = 0; i < count; i++)
+    {
+        fail_if (batch[i] != GINT_TO_POINTER (i + 1),
+                 "Pop many failed");
+    }
+
+    async_queue_disable (queue);
+
+    count = async_queue_pop_many (queue, batch, BOUNDED_SIZE);
+    fail_if (count != 0,
+             "Disable failed");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+static gpointer
+pop_many_func (gpointer data)
+{
+    AsyncQueue *queue;
+    gpointer foo;
+    guint i;
+
+    queue = data;
+    foo = GINT_TO_POINTER (1);
+    i = 0;
+    while (i < PROCESS_COUNT)
+    {
+        gpointer batch[BOUNDED_SIZE];
+        guint count;
+        guint j;
+
+        count = async_queue_pop_many (queue, batch, BOUNDED_SIZE);
+        fail_if (count == 0,
+                 "Pop many failed");
+        for (j = 0; j < count; j++, i++, foo++)
+        {
+            fail_if (batch[j] != foo,
+                     "Pop many failed");
+        }
+    }
+
+    return NULL;
+}
+
+START_TEST (test_async_queue_pop_many_threads)
+{
+    AsyncQueue *queue;
+    GThread *push_thread;
+    GThread *pop_thread;
+
+    queue = async_queue_new ();
+    fail_if (!queue,
+             "Construction failed");
+
+    pop_thread = g_thread_create (pop_many_func, queue, TRUE, NULL);
+    push_thread = g_thread_create (push_func, queue, TRUE, NULL);
+
+    g_thread_join (pop_thread);
+    g_thread_join (push_thread);
+
+    async_queue_free (queue);
+
+    queue = async_queue_new_bounded (PROCESS_COUNT);
+    fail_if (!queue,
+             "Construction failed");
+
+    pop_thread = g_thread_create (pop_many_func, queue, TRUE, NULL);
+    push_thread = g_thread_create (push_func, queue, TRUE, NULL);
+
+    g_thread_join (pop_thread);
+    g_thread_join (push_thread);
+
+    async_queue_free (queue);
+}
+END_TEST
+
+static void
+watermark_func (AsyncQueue *queue,
+                gboolean high,
+                gpointer data)
+{
+    gint *crossings;
+
+    crossings = data;
+    fail_if ((*crossings % 2 == 0) != high,
+             "Watermark out of order");
+    (*crossings)++;
+}
+
+START_TEST (test_async_queue_watermarks)
+{
+    AsyncQueue *queue;
+    gint crossings = 0;
+    guint i;
+
+    queue = async_queue_new_bounded (BOUNDED_SIZE);
+    fail_if (!queue,
+             "Construction failed");
+
+    async_queue_set_watermarks (queue, 2, 6, watermark_func, &crossings);
+
+    for (i = 0; i < 5; i++)
+        async_queue_push (queue, GINT_TO_POINTER (i + 1));
+
+    fail_if (crossings != 0,
+             "High watermark too early");
+
+    async_queue_push (queue, GINT_TO_POINTER (6));
+
+    fail_if (crossings != 1,
+             "High watermark missed");
+
+    for (i = 0; i < 3; i++)
+        async_queue_pop (queue);
+
+    fail_if (crossings != 1,
+             "Low watermark too early");
+
+    async_queue_pop (queue);
+
+    fail_if (crossings != 2,
+             "Low watermark missed");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+static void
+watermark_stats_func (AsyncQueue *queue,
+                      gboolean high,
+                      gpointer data)
+{
+    AsyncQueueStats stats;
+
+    /* The queue isn't locked anymore while we are told. */
+    async_queue_get_stats (queue, &stats);
+    watermark_func (queue, high, data);
+}
+
+START_TEST (test_async_queue_watermarks_unlocked)
+{
+    AsyncQueue *queue;
+    gint crossings = 0;
+    guint i;
+
+    queue = async_queue_new ();
+    fail_if (!queue,
+             "Construction failed");
+
+    async_queue_set_watermarks (queue, 1, 3, watermark_stats_func, &crossings);
+
+    for (i = 0; i < 3; i++)
+        async_queue_push (queue, GINT_TO_POINTER (i + 1));
+
+    fail_if (crossings != 1,
+             "High watermark missed");
+
+    for (i = 0; i < 2; i++)
+        async_queue_pop (queue);
+
+    fail_if (crossings != 2,
+             "Low watermark missed");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+START_TEST (test_async_queue_stats)
+{
+    AsyncQueue *queue;
+    AsyncQueueStats stats;
+    guint i;
+
+    queue = async_queue_new_bounded (BOUNDED_SIZE);
+    fail_if (!queue,
+             "Construction failed");
+
+    for (i = 0; i < 3; i++)
+        async_queue_push (queue, GINT_TO_POINTER (i + 1));
+
+    async_queue_pop (queue);
+    async_queue_pop (queue);
+    async_queue_pop (queue);
+
+    /* times out after blocking */
+    async_queue_pop_timed (queue, 1000);
+
+    async_queue_disable (queue);
+    async_queue_pop (queue);
+
+    async_queue_get_stats (queue, &stats);
+
+    fail_if (stats.pushes != 3 || stats.pops != 3,
+             "Wrong push or pop count");
+    fail_if (stats.length != 0 || stats.max_length != 3,
+             "Wrong length");
+    fail_if (stats.waits.count != 1 || stats.waits.time < 1000,
+             "Wrong wait count");
+    fail_if (stats.disabled_pops != 1,
+             "Wrong disabled pop count");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+START_TEST (test_async_queue_pop_timed)
+{
+    AsyncQueue *queue;
+    gpointer foo;
+
+    queue = async_queue_new_bounded (BOUNDED_SIZE);
+    fail_if (!queue,
+             "Construction failed");
+
+    fail_if (async_queue_pop_timed (queue, 1000) != NULL,
+             "Timed pop didn't time out");
+
+    foo = GINT_TO_POINTER (1);
+    async_queue_push (queue, foo);
+    fail_if (async_queue_length (queue) != 1,
+             "Wrong length");
+    fail_if (async_queue_pop_timed (queue, 1000) != foo,
+             "Timed pop failed");
+    fail_if (async_queue_length (queue) != 0,
+             "Wrong length");
+
+    async_queue_free (queue);
+
+    queue = async_queue_new ();
+    fail_if (!queue,
+             "Construction failed");
+
+    fail_if (async_queue_pop_timed (queue, 1000) != NULL,
+             "Timed pop didn't time out");
+
+    async_queue_push (queue, foo);
+    fail_if (async_queue_length (queue) != 1,
+             "Wrong length");
+    fail_if (async_queue_pop_timed (queue, 1000) != foo,
+             "Timed pop failed");
+
+    async_queue_free (queue);
+}
+END_TEST
+
 Suite *
 util_suite (void)
 {
@@ -281,6 +671,16 @@ util_suite (void)
     tcase_add_test (tc_core, test_async_queue_disable_simple);
     tcase_add_test (tc_core, test_async_queue_disable);
     tcase_add_test (tc_core, test_async_queue_enable);
+    tcase_add_test (tc_core, test_async_queue_bounded_process);
+    tcase_add_test (tc_core, test_async_queue_bounded_threads);
+    tcase_add_test (tc_core, test_async_queue_bounded_disable);
+    tcase_add_test (tc_core, test_async_queue_spin);
+    tcase_add_test (tc_core, test_async_queue_pop_many);
+    tcase_add_test (tc_core, test_async_queue_pop_many_threads);
+    tcase_add_test (tc_core, test_async_queue_pop_timed);
+    tcase_add_test (tc_core, test_async_queue_watermarks);
+    tcase_add_test (tc_core, test_async_queue_watermarks_unlocked);
+    tcase_add_test (tc_core, test_async_queue_stats);
     suite_add_tcase (s, tc_core);
 
     return s;
@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include <string.h>
+#include <stdlib.h>
+#include "gstomx_util.h"
+
+#define LIBRARY_NAME "libomxil-foo.so"
+#define COMPONENT_NAME "OMX.check.dummy"
+#define SYNC_COMPONENT_NAME "OMX.check.sync"
+
+#define BUFFER_COUNT 4
+#define BUFFER_SIZE 1000
+#define ALIGNMENT 256
+
+static GOmxPort *
+setup_port (GOmxCore *core,
+            guint index,
+            GOmxAllocation allocation)
+{
+    GOmxPort *port;
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+    param.nPortIndex = index;
+
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+
+    param.nBufferCountMin = BUFFER_COUNT;
+    param.nBufferSize = BUFFER_SIZE;
+    param.nBufferAlignment = ALIGNMENT;
+    param.bBuffersContiguous = OMX_TRUE;
+
+    port = g_omx_core_setup_port (core, &param);
+    port->allocation = allocation;
+
+    return port;
+}
+
+START_TEST (test_buffers_aligned)
+{
+    GOmxCore *core;
+    GOmxPort *port;
+    guint i;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+    core->prefault = TRUE;
+
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    port = setup_port (core, 0, GOMX_ALLOCATION_USE);
+    setup_port (core, 1, GOMX_ALLOCATION_USE);
+
+    g_omx_core_prepare (core);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Prepare failed");
+
+    for (i = 0; i < port->num_buffers; i++)
+    {
+        OMX_U8 *data;
+
+        data = port->buffers[i]->pBuffer;
+
+        fail_if (GPOINTER_TO_SIZE (data) % ALIGNMENT != 0,
+                 "Buffer not aligned");
+        fail_if (data < (OMX_U8 *) port->slab ||
+                 data + BUFFER_SIZE > (OMX_U8 *) port->slab + port->slab_size,
+                 "Buffer not in the slab");
+
+        if (i > 0)
+        {
+            fail_if (data - port->buffers[i - 1]->pBuffer != 1024,
+                     "Buffers not next to each other");
+        }
+    }
+
+    g_omx_core_finish (core);
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_buffers_allocate)
+{
+    GOmxCore *core;
+    GOmxPort *in_port;
+    GOmxPort *out_port;
+    guint i;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    in_port = setup_port (core, 0, GOMX_ALLOCATION_ALLOCATE);
+    out_port = setup_port (core, 1, GOMX_ALLOCATION_AUTO);
+
+    g_omx_core_prepare (core);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Prepare failed");
+
+    fail_if (!in_port->allocated || !out_port->allocated,
+             "Component didn't allocate");
+    fail_if (in_port->slab || out_port->slab,
+             "Slab allocated anyway");
+
+    for (i = 0; i < in_port->num_buffers; i++)
+    {
+        OMX_BUFFERHEADERTYPE *omx_buffer;
+
+        omx_buffer = in_port->buffers[i];
+        fail_if (!omx_buffer || !omx_buffer->pBuffer,
+                 "Missing buffer");
+
+        /* Not ours to free; the component checks it gets it back. */
+        g_omx_port_free_buffer_data (in_port, omx_buffer);
+        fail_if (!omx_buffer->pBuffer,
+                 "Component's data freed");
+    }
+
+    g_omx_core_finish (core);
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_buffers_auto_fallback)
+{
+    GOmxCore *core;
+    GOmxPort *port;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    /* This one only takes our buffers. */
+    g_omx_core_init (core, LIBRARY_NAME, "OMX.check.use_buffer");
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    port = setup_port (core, 0, GOMX_ALLOCATION_AUTO);
+    setup_port (core, 1, GOMX_ALLOCATION_AUTO);
+
+    g_omx_core_prepare (core);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Prepare failed");
+
+    fail_if (port->allocated,
+             "Component allocated");
+    fail_if (!port->slab,
+             "No slab");
+    fail_if (port->buffers[0]->pBuffer != port->slab,
+             "Buffer not in the slab");
+
+    g_omx_core_finish (core);
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_buffers_allocate_fail)
+{
+    GOmxCore *core;
+    GOmxPort *port;
+    guint i;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    /* This one runs out after two buffers. */
+    g_omx_core_init (core, LIBRARY_NAME, "OMX.check.allocate_two");
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    port = setup_port (core, 0, GOMX_ALLOCATION_AUTO);
+    setup_port (core, 1, GOMX_ALLOCATION_AUTO);
+
+    g_omx_core_prepare (core);
+    fail_if (core->omx_error != OMX_ErrorInsufficientResources,
+             "Prepare didn't fail");
+
+    for (i = 0; i < port->num_buffers; i++)
+    {
+        fail_if (port->buffers[i],
+                 "Buffer left behind");
+    }
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_buffers_count)
+{
+    GOmxCore *core;
+    GOmxBufferCount count;
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+    GOmxPort *port;
+    guint expected[] = { 2, 4, 8, 8 };
+    guint i;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nBufferCountMin = 2;
+    param.nBufferCountActual = 3;
+    param.eDir = OMX_DirInput;
+
+    memset (&count, 0, sizeof (count));
+
+    /* What the component suggests. */
+    port = g_omx_core_setup_port_count (core, &param, &count);
+    fail_if (port->num_buffers != 3,
+             "Suggested count not taken");
+
+    /* Never less than the minimum. */
+    count.wanted = 1;
+    port = g_omx_core_setup_port_count (core, &param, &count);
+    fail_if (port->num_buffers != 2,
+             "Minimum not respected");
+
+    /* Auto doubles whenever the port starved, up to a limit. */
+    count.wanted = GOMX_BUFFERS_AUTO;
+    for (i = 0; i < G_N_ELEMENTS (expected); i++)
+    {
+        port = g_omx_core_setup_port_count (core, &param, &count);
+        fail_if (!port->warming_up,
+                 "Not watching");
+        fail_if (port->num_buffers != expected[i],
+                 "Unexpected count");
+        count.grow = TRUE;
+    }
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_buffers_lend)
+{
+    GOmxCore *core;
+    GOmxPort *port;
+    OMX_BUFFERHEADERTYPE *omx_buffers[BUFFER_COUNT];
+    OMX_U8 *data;
+    guint i;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    setup_port (core, 0, GOMX_ALLOCATION_USE);
+    port = setup_port (core, 1, GOMX_ALLOCATION_USE);
+
+    g_omx_core_prepare (core);
+    g_omx_core_start (core);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Start failed");
+
+    for (i = 0; i < BUFFER_COUNT; i++)
+        omx_buffers[i] = g_omx_port_request_buffer (port);
+
+    /* The component always keeps one. */
+    for (i = 0; i < BUFFER_COUNT - 1; i++)
+    {
+        fail_if (!g_omx_port_lend_buffer (port, omx_buffers[i]),
+                 "Lend failed");
+    }
+    fail_if (g_omx_port_lend_buffer (port, omx_buffers[i]),
+             "Lent the last buffer");
+    g_omx_port_release_buffer (port, omx_buffers[i]);
+
+    /* Back to the component right away. */
+    g_omx_port_return_buffer (port, omx_buffers[0]);
+    fail_if (port->lent != BUFFER_COUNT - 2,
+             "Not returned");
+    fail_if (g_atomic_int_get (&port->component_buffers) != 2,
+             "Not handed to the component");
+
+    /* The rest outlive the component's buffers. */
+    data = omx_buffers[1]->pBuffer;
+    g_omx_core_finish (core);
+
+    fail_if (!port->orphaned,
+             "Not orphaned");
+    memset (data, 0, BUFFER_SIZE);
+
+    g_omx_port_return_buffer (port, omx_buffers[1]);
+    g_omx_port_return_buffer (port, omx_buffers[2]);
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+static void
+count_return (gpointer data)
+{
+    (*(guint *) data)++;
+}
+
+START_TEST (test_buffers_borrow)
+{
+    GOmxCore *core;
+    GOmxPort *in_port;
+    GOmxPort *out_port;
+    OMX_BUFFERHEADERTYPE *omx_buffers[BUFFER_COUNT];
+    OMX_BUFFERHEADERTYPE *omx_buffer;
+    OMX_U8 *own_data;
+    gpointer data;
+    guint returned = 0;
+    guint i;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    in_port = setup_port (core, 0, GOMX_ALLOCATION_USE);
+    out_port = setup_port (core, 1, GOMX_ALLOCATION_USE);
+
+    g_omx_core_prepare (core);
+    g_omx_core_start (core);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Start failed");
+
+    for (i = 0; i < BUFFER_COUNT; i++)
+    {
+        omx_buffers[i] = g_omx_port_request_buffer (in_port);
+        omx_buffer = g_omx_port_request_buffer (out_port);
+    }
+
+    fail_if (posix_memalign (&data, ALIGNMENT, BUFFER_SIZE) != 0,
+             "No memory");
+    memset (data, 0x42, BUFFER_SIZE);
+
+    own_data = omx_buffers[0]->pBuffer;
+
+    fail_if (g_omx_port_borrow_data (in_port, omx_buffers[0], data, BUFFER_SIZE + 1,
+                                     &returned, count_return),
+             "Borrowed too much");
+    fail_if (g_omx_port_borrow_data (in_port, omx_buffers[0], (OMX_U8 *) data + 1, BUFFER_SIZE - 1,
+                                     &returned, count_return),
+             "Borrowed misaligned data");
+    fail_if (!g_omx_port_borrow_data (in_port, omx_buffers[0], data, BUFFER_SIZE,
+                                      &returned, count_return),
+             "Borrow failed");
+    fail_if (omx_buffers[0]->pBuffer != data,
+             "Data not borrowed");
+
+    g_omx_port_release_buffer (in_port, omx_buffers[0]);
+    g_omx_port_release_buffer (out_port, omx_buffer);
+
+    /* The component read the borrowed data, and gave it back. */
+    omx_buffer = g_omx_port_request_buffer (out_port);
+    fail_if (omx_buffer->nFilledLen != BUFFER_SIZE ||
+             omx_buffer->pBuffer[0] != 0x42,
+             "Borrowed data not processed");
+
+    omx_buffer = g_omx_port_request_buffer (in_port);
+    fail_if (omx_buffer != omx_buffers[0],
+             "Unexpected buffer");
+    fail_if (returned != 1,
+             "Owner not notified");
+    fail_if (omx_buffer->pBuffer != own_data ||
+             omx_buffer->nAllocLen != BUFFER_SIZE ||
+             omx_buffer->pAppPrivate,
+             "Own data not restored");
+
+    g_omx_core_finish (core);
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+
+    free (data);
+}
+END_TEST
+
+static OMX_BUFFERHEADERTYPE *relent;
+
+/* Like an element lending each buffer on as soon as it's filled. */
+static gboolean
+lend_again (GOmxPort *port,
+            OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    if (!g_omx_port_lend_buffer (port, omx_buffer))
+        return FALSE;
+
+    relent = omx_buffer;
+
+    return TRUE;
+}
+
+START_TEST (test_buffers_return_sync)
+{
+    GOmxCore *core;
+    GOmxPort *port;
+    OMX_BUFFERHEADERTYPE *omx_buffer;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, LIBRARY_NAME, SYNC_COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    setup_port (core, 0, GOMX_ALLOCATION_USE);
+    port = setup_port (core, 1, GOMX_ALLOCATION_USE);
+
+    g_omx_core_prepare (core);
+    g_omx_core_start (core);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Start failed");
+
+    omx_buffer = g_omx_port_request_buffer (port);
+    fail_if (!g_omx_port_lend_buffer (port, omx_buffer),
+             "Lend failed");
+
+    /* The component fills it before FillThisBuffer returns, and it's lent
+     * again from there. */
+    relent = NULL;
+    port->direct_cb = lend_again;
+    g_omx_port_return_buffer (port, omx_buffer);
+
+    fail_if (relent != omx_buffer,
+             "Not lent again");
+    fail_if (port->lent != 1,
+             "Wrong lent count");
+
+    port->direct_cb = NULL;
+    g_omx_core_finish (core);
+    g_omx_port_return_buffer (port, omx_buffer);
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+Suite *
+util_suite (void)
+{
+    Suite *s = suite_create ("buffers");
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    /* Core test case */
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_buffers_aligned);
+    tcase_add_test (tc_core, test_buffers_allocate);
+    tcase_add_test (tc_core, test_buffers_auto_fallback);
+    tcase_add_test (tc_core, test_buffers_allocate_fail);
+    tcase_add_test (tc_core, test_buffers_count);
+    tcase_add_test (tc_core, test_buffers_lend);
+    tcase_add_test (tc_core, test_buffers_borrow);
+    tcase_add_test (tc_core, test_buffers_return_sync);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = util_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
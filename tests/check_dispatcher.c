@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include "async_queue.h"
+#include "dispatcher.h"
+
+#define PROCESS_COUNT 0x1000
+#define QUEUE_COUNT 0x10
+#define BATCH_SIZE 0x10
+
+typedef struct
+{
+    AsyncQueue *queue;
+    AsyncQueue *done;
+    guint next;
+} Consumer;
+
+static void
+consume (gpointer data)
+{
+    Consumer *consumer;
+    gpointer batch[BATCH_SIZE];
+    guint count;
+    guint i;
+
+    consumer = data;
+    count = async_queue_try_pop_many (consumer->queue, batch, BATCH_SIZE);
+
+    for (i = 0; i < count; i++)
+    {
+        fail_if (GPOINTER_TO_INT (batch[i]) != consumer->next,
+                 "Pop failed");
+        consumer->next++;
+
+        if (consumer->next == PROCESS_COUNT + 1)
+            async_queue_push (consumer->done, consumer);
+    }
+}
+
+START_TEST (test_dispatcher_create)
+{
+    Dispatcher *dispatcher;
+    dispatcher = dispatcher_new (2);
+    fail_if (!dispatcher,
+             "Construction failed");
+    dispatcher_free (dispatcher);
+}
+END_TEST
+
+START_TEST (test_dispatcher_queues)
+{
+    Dispatcher *dispatcher;
+    AsyncQueue *done;
+    Consumer consumers[QUEUE_COUNT];
+    guint i;
+    guint j;
+
+    dispatcher = dispatcher_new (2);
+    fail_if (!dispatcher,
+             "Construction failed");
+
+    done = async_queue_new ();
+
+    for (i = 0; i < QUEUE_COUNT; i++)
+    {
+        gint fd;
+
+        consumers[i].queue = async_queue_new_bounded (PROCESS_COUNT);
+        consumers[i].done = done;
+        consumers[i].next = 1;
+
+        fd = async_queue_get_fd (consumers[i].queue);
+        fail_if (fd < 0,
+                 "No file descriptor");
+        fail_if (!dispatcher_add (dispatcher, fd, consume, &consumers[i]),
+                 "Add failed");
+    }
+
+    for (j = 1; j <= PROCESS_COUNT; j++)
+    {
+        for (i = 0; i < QUEUE_COUNT; i++)
+        {
+            async_queue_push (consumers[i].queue, GINT_TO_POINTER (j));
+        }
+    }
+
+    /* every consumer reports once it got everything */
+    for (i = 0; i < QUEUE_COUNT; i++)
+    {
+        fail_if (!async_queue_pop (done),
+                 "Pop failed");
+    }
+
+    for (i = 0; i < QUEUE_COUNT; i++)
+    {
+        dispatcher_remove (dispatcher, async_queue_get_fd (consumers[i].queue));
+        async_queue_free (consumers[i].queue);
+    }
+
+    async_queue_free (done);
+    dispatcher_free (dispatcher);
+}
+END_TEST
+
+typedef struct
+{
+    AsyncQueue *queue;
+    AsyncQueue *wait; /**< Blocks on this once it got its item... */
+    AsyncQueue *wake; /**< ...then pushes to this. */
+} Blocker;
+
+static void
+block (gpointer data)
+{
+    Blocker *blocker;
+
+    blocker = data;
+
+    if (!async_queue_try_pop_many (blocker->queue, &data, 1))
+        return;
+
+    if (blocker->wait)
+        async_queue_pop (blocker->wait);
+    async_queue_push (blocker->wake, blocker);
+}
+
+START_TEST (test_dispatcher_blocking)
+{
+    Dispatcher *dispatcher;
+    AsyncQueue *done;
+    Blocker first;
+    Blocker second;
+
+    /* One loop; the first callback blocks until the second one ran. */
+    dispatcher = dispatcher_new (1);
+    fail_if (!dispatcher,
+             "Construction failed");
+
+    done = async_queue_new ();
+    first.queue = async_queue_new ();
+    first.wait = async_queue_new ();
+    first.wake = done;
+    second.queue = async_queue_new ();
+    second.wait = NULL;
+    second.wake = first.wait;
+
+    fail_if (!dispatcher_add (dispatcher, async_queue_get_fd (first.queue), block, &first),
+             "Add failed");
+    fail_if (!dispatcher_add (dispatcher, async_queue_get_fd (second.queue), block, &second),
+             "Add failed");
+
+    async_queue_push (first.queue, &first);
+    async_queue_push (second.queue, &second);
+
+    fail_if (async_queue_pop (done) != &first,
+             "Pop failed");
+
+    dispatcher_remove (dispatcher, async_queue_get_fd (first.queue));
+    dispatcher_remove (dispatcher, async_queue_get_fd (second.queue));
+
+    async_queue_free (first.queue);
+    async_queue_free (first.wait);
+    async_queue_free (second.queue);
+    async_queue_free (done);
+    dispatcher_free (dispatcher);
+}
+END_TEST
+
+Suite *
+util_suite (void)
+{
+    Suite *s = suite_create ("dispatcher");
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    /* Core test case */
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_dispatcher_create);
+    tcase_add_test (tc_core, test_dispatcher_queues);
+    tcase_add_test (tc_core, test_dispatcher_blocking);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = util_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include <string.h>
+#include "gstomx_util.h"
+
+#define LIBRARY_NAME "libomxil-foo.so"
+#define MISSING_LIBRARY_NAME "libomxil-missing.so"
+#define COMPONENT_NAME "OMX.check.dummy"
+
+START_TEST (test_failover_missing)
+{
+    GOmxCore *core;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, MISSING_LIBRARY_NAME ":" LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+    fail_if (strcmp (g_omx_core_get_library_name (core), LIBRARY_NAME) != 0,
+             "Wrong library");
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_failover_auto)
+{
+    const gchar *names[] = { MISSING_LIBRARY_NAME, LIBRARY_NAME, NULL };
+    GOmxCore *core;
+
+    g_omx_init ();
+    g_omx_set_libraries (names);
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, "auto", COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+    fail_if (strcmp (g_omx_core_get_library_name (core), LIBRARY_NAME) != 0,
+             "Wrong library");
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_failover_role)
+{
+    GOmxCore *core;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init_role (core, LIBRARY_NAME, COMPONENT_NAME, "dummy");
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+    g_omx_core_deinit (core);
+
+    /* No library has a component that does this. */
+    g_omx_core_init_role (core, LIBRARY_NAME, COMPONENT_NAME, "video_decoder.avc");
+    fail_if (core->omx_error == OMX_ErrorNone,
+             "Init didn't fail");
+    fail_if (core->imp,
+             "Component left behind");
+
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_failover_busy)
+{
+    GOmxCore *core;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    g_omx_core_init (core, LIBRARY_NAME ":" LIBRARY_NAME, "OMX.check.busy");
+    fail_if (core->omx_error != OMX_ErrorInsufficientResources,
+             "Init didn't run out of resources");
+    fail_if (core->imp,
+             "Component left behind");
+    fail_if (g_omx_core_failover (core),
+             "Failover without a component");
+
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+Suite *
+util_suite (void)
+{
+    Suite *s = suite_create ("failover");
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    /* Core test case */
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_failover_missing);
+    tcase_add_test (tc_core, test_failover_auto);
+    tcase_add_test (tc_core, test_failover_role);
+    tcase_add_test (tc_core, test_failover_busy);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = util_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
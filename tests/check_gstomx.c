@@ -24,6 +24,10 @@
 #define BUFFER_SIZE 0x1000
 #define BUFFER_COUNT 0x100
 #define FLUSH_AT 0x10
+#define FRAME_COUNT 0x8
+#define FRAME_DURATION (20 * GST_MSECOND)
+#define UPSTREAM_LATENCY (5 * GST_MSECOND)
+#define SLOW_DELAY (10 * GST_MSECOND) /* OMX.check.slow, per buffer */
 
 static gboolean
 bus_cb (GstBus *bus,
@@ -67,23 +71,47 @@ GST_STATIC_PAD_TEMPLATE ("src",
                          GST_PAD_ALWAYS,
                          GST_STATIC_CAPS_ANY);
 
-static void
-helper (gboolean flush)
+static GstPad *mysrcpad;
+static GstPad *mysinkpad;
+static GstBus *bus;
+static guint eos_count; /**< EOS events that reached mysinkpad; check_mutex. */
+
+static gboolean
+eos_probe (GstPad *pad,
+           GstEvent *event,
+           gpointer data)
+{
+    if (GST_EVENT_TYPE (event) == GST_EVENT_EOS)
+    {
+        g_mutex_lock (check_mutex);
+        eos_count++;
+        g_cond_broadcast (check_cond);
+        g_mutex_unlock (check_mutex);
+    }
+
+    return TRUE;
+}
+
+static GstElement *
+setup_filter (const gchar *component_name,
+              gboolean low_latency)
 {
     GstElement *filter;
-    GstBus *bus;
-    GstPad *mysrcpad;
-    GstPad *mysinkpad;
 
     /* init */
     filter = gst_check_setup_element ("omx_dummy");
     mysrcpad = gst_check_setup_src_pad (filter, &srctemplate, NULL);
     mysinkpad = gst_check_setup_sink_pad (filter, &sinktemplate, NULL);
+    eos_count = 0;
+    gst_pad_add_event_probe (mysinkpad, G_CALLBACK (eos_probe), NULL);
 
     gst_pad_set_active (mysrcpad, TRUE);
     gst_pad_set_active (mysinkpad, TRUE);
 
     g_object_set (G_OBJECT (filter), "library-name", "libomxil-foo.so", NULL);
+    if (component_name)
+        g_object_set (G_OBJECT (filter), "component-name", component_name, NULL);
+    g_object_set (G_OBJECT (filter), "low-latency", low_latency, NULL);
 
     /* start */
 
@@ -94,6 +122,146 @@ helper (gboolean flush)
 
     gst_element_set_bus (filter, bus);
 
+    return filter;
+}
+
+static void
+teardown_filter (GstElement *filter)
+{
+    /* cleanup */
+    gst_bus_set_flushing (bus, TRUE);
+    gst_element_set_bus (filter, NULL);
+    gst_object_unref (GST_OBJECT (bus));
+    gst_check_drop_buffers ();
+
+    /* deinit */
+    gst_element_set_state (filter, GST_STATE_NULL);
+
+    gst_pad_set_active (mysrcpad, FALSE);
+    gst_pad_set_active (mysinkpad, FALSE);
+    gst_check_teardown_src_pad (filter);
+    gst_check_teardown_sink_pad (filter);
+    gst_check_teardown_element (filter);
+}
+
+/** Pushes count timestamped buffers, one frame each. */
+static void
+push_frames (guint count)
+{
+    guint i;
+
+    for (i = 0; i < count; i++)
+    {
+        GstBuffer *inbuffer;
+        inbuffer = gst_buffer_new_and_alloc (BUFFER_SIZE);
+        GST_BUFFER_DATA(inbuffer)[0] = i;
+        GST_BUFFER_TIMESTAMP (inbuffer) = i * FRAME_DURATION;
+        GST_BUFFER_DURATION (inbuffer) = FRAME_DURATION;
+
+        fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    }
+}
+
+/** Waits up to timeout microseconds for count buffers to reach mysinkpad. */
+static guint
+wait_for_buffers (guint count,
+                  gulong timeout)
+{
+    GTimeVal deadline;
+    guint n;
+
+    g_get_current_time (&deadline);
+    g_time_val_add (&deadline, timeout);
+
+    g_mutex_lock (check_mutex);
+    while (g_list_length (buffers) < count)
+    {
+        if (!g_cond_timed_wait (check_cond, check_mutex, &deadline))
+            break;
+    }
+    n = g_list_length (buffers);
+    g_mutex_unlock (check_mutex);
+
+    return n;
+}
+
+/**
+ * Waits up to timeout microseconds for EOS to reach mysinkpad; the filter
+ * sends it on from its own thread once the component has drained.
+ */
+static gboolean
+wait_for_eos (gulong timeout)
+{
+    GTimeVal deadline;
+    gboolean eos;
+
+    g_get_current_time (&deadline);
+    g_time_val_add (&deadline, timeout);
+
+    g_mutex_lock (check_mutex);
+    while (eos_count == 0)
+    {
+        if (!g_cond_timed_wait (check_cond, check_mutex, &deadline))
+            break;
+    }
+    eos = eos_count > 0;
+    g_mutex_unlock (check_mutex);
+
+    return eos;
+}
+
+/**
+ * Gets an EOS event held by the filter, behind input the component never
+ * processes. A reference is kept, to tell when the filter lets go of it.
+ */
+static GstEvent *
+hold_eos (void)
+{
+    GstEvent *event;
+
+    push_frames (1);
+
+    event = gst_event_new_eos ();
+    gst_event_ref (event);
+    fail_unless (gst_pad_push_event (mysrcpad, event));
+    ASSERT_MINI_OBJECT_REFCOUNT (event, "eos", 2);
+
+    return event;
+}
+
+/** Upstream of the filter, a live source with a fixed latency. */
+static gboolean
+upstream_query (GstPad *pad,
+                GstQuery *query)
+{
+    if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY)
+        return FALSE;
+
+    gst_query_set_latency (query, TRUE, UPSTREAM_LATENCY, GST_CLOCK_TIME_NONE);
+    return TRUE;
+}
+
+static void
+query_latency (GstClockTime *min,
+               GstClockTime *max)
+{
+    GstQuery *query;
+    gboolean live;
+
+    query = gst_query_new_latency ();
+    fail_unless (gst_pad_peer_query (mysinkpad, query));
+    gst_query_parse_latency (query, &live, min, max);
+    fail_unless (live);
+    gst_query_unref (query);
+}
+
+static void
+helper (gboolean flush)
+{
+    GstElement *filter;
+
+    filter = setup_filter (NULL, FALSE);
+
     /* send buffers in order*/
     {
         guint i;
@@ -125,6 +293,7 @@ helper (gboolean flush)
     }
 
     gst_pad_push_event (mysrcpad, gst_event_new_eos ());
+    fail_unless (wait_for_eos (5 * G_USEC_PER_SEC));
 
     /* check the order of the buffers*/
     if (!flush)
@@ -140,20 +309,7 @@ helper (gboolean flush)
         fail_unless (i == BUFFER_COUNT);
     }
 
-    /* cleanup */
-    gst_bus_set_flushing (bus, TRUE);
-    gst_element_set_bus (filter, NULL);
-    gst_object_unref (GST_OBJECT (bus));
-    gst_check_drop_buffers ();
-
-    /* deinit */
-    gst_element_set_state (filter, GST_STATE_NULL);
-
-    gst_pad_set_active (mysrcpad, FALSE);
-    gst_pad_set_active (mysinkpad, FALSE);
-    gst_check_teardown_src_pad (filter);
-    gst_check_teardown_sink_pad (filter);
-    gst_check_teardown_element (filter);
+    teardown_filter (filter);
 }
 
 GST_START_TEST (test_flush)
@@ -168,6 +324,134 @@ GST_START_TEST (test_basic)
 }
 GST_END_TEST
 
+/* OMX.check.stuck never processes anything, so EOS stays held. */
+
+GST_START_TEST (test_flush_eos)
+{
+    GstElement *filter;
+    GstEvent *event;
+
+    filter = setup_filter ("OMX.check.stuck", FALSE);
+    /* one for the stuck input, one for EOS */
+    g_object_set (G_OBJECT (filter), "input-buffers", 2, NULL);
+
+    event = hold_eos ();
+
+    gst_pad_push_event (mysrcpad, gst_event_new_flush_start ());
+    ASSERT_MINI_OBJECT_REFCOUNT (event, "eos", 1);
+    gst_pad_push_event (mysrcpad, gst_event_new_flush_stop ());
+
+    fail_if (wait_for_eos (G_USEC_PER_SEC / 10));
+    gst_event_unref (event);
+
+    teardown_filter (filter);
+}
+GST_END_TEST
+
+GST_START_TEST (test_stop_eos)
+{
+    GstElement *filter;
+    GstEvent *event;
+
+    filter = setup_filter ("OMX.check.stuck", FALSE);
+    g_object_set (G_OBJECT (filter), "input-buffers", 2, NULL);
+
+    event = hold_eos ();
+
+    fail_unless_equals_int (gst_element_set_state (filter, GST_STATE_READY),
+                            GST_STATE_CHANGE_SUCCESS);
+    ASSERT_MINI_OBJECT_REFCOUNT (event, "eos", 1);
+
+    fail_if (wait_for_eos (G_USEC_PER_SEC / 10));
+    gst_event_unref (event);
+
+    teardown_filter (filter);
+}
+GST_END_TEST
+
+/* OMX.check.frames drops input that doesn't end a frame. */
+
+GST_START_TEST (test_low_latency_frames)
+{
+    GstElement *filter;
+
+    filter = setup_filter ("OMX.check.frames", TRUE);
+
+    push_frames (FRAME_COUNT);
+    fail_unless_equals_int (wait_for_buffers (FRAME_COUNT, G_USEC_PER_SEC),
+                            FRAME_COUNT);
+
+    teardown_filter (filter);
+}
+GST_END_TEST
+
+GST_START_TEST (test_frames)
+{
+    GstElement *filter;
+
+    filter = setup_filter ("OMX.check.frames", FALSE);
+
+    push_frames (FRAME_COUNT);
+    fail_unless_equals_int (wait_for_buffers (1, G_USEC_PER_SEC / 10), 0);
+
+    teardown_filter (filter);
+}
+GST_END_TEST
+
+GST_START_TEST (test_low_latency_query)
+{
+    GstElement *filter;
+    GstMessage *message;
+    GstClockTime min;
+    GstClockTime max;
+
+    filter = setup_filter ("OMX.check.slow", TRUE);
+    gst_pad_set_query_function (mysrcpad, upstream_query);
+
+    push_frames (FRAME_COUNT);
+    fail_unless_equals_int (wait_for_buffers (FRAME_COUNT, G_USEC_PER_SEC),
+                            FRAME_COUNT);
+
+    /* the pipeline was told to ask again */
+    message = gst_bus_poll (bus, GST_MESSAGE_LATENCY, 0);
+    fail_unless (message != NULL);
+    gst_message_unref (message);
+
+    /* the component's delay is added to upstream's */
+    query_latency (&min, &max);
+    fail_unless (min >= UPSTREAM_LATENCY + SLOW_DELAY);
+    fail_unless (max == GST_CLOCK_TIME_NONE);
+
+    teardown_filter (filter);
+}
+GST_END_TEST
+
+GST_START_TEST (test_query)
+{
+    GstElement *filter;
+    GstMessage *message;
+    GstClockTime min;
+    GstClockTime max;
+
+    filter = setup_filter ("OMX.check.slow", FALSE);
+    gst_pad_set_query_function (mysrcpad, upstream_query);
+
+    push_frames (FRAME_COUNT);
+    fail_unless_equals_int (wait_for_buffers (FRAME_COUNT, G_USEC_PER_SEC),
+                            FRAME_COUNT);
+
+    /* only low-latency mode measures the component */
+    message = gst_bus_poll (bus, GST_MESSAGE_LATENCY, 0);
+    fail_if (message);
+
+    query_latency (&min, &max);
+    fail_unless (min == UPSTREAM_LATENCY);
+    fail_unless (max == GST_CLOCK_TIME_NONE);
+
+    teardown_filter (filter);
+}
+GST_END_TEST
+
 static Suite *
 gstomx_suite (void)
 {
@@ -177,6 +461,12 @@ gstomx_suite (void)
   tcase_set_timeout (tc_chain, 10);
   tcase_add_test (tc_chain, test_basic);
   tcase_add_test (tc_chain, test_flush);
+  tcase_add_test (tc_chain, test_flush_eos);
+  tcase_add_test (tc_chain, test_stop_eos);
+  tcase_add_test (tc_chain, test_low_latency_frames);
+  tcase_add_test (tc_chain, test_frames);
+  tcase_add_test (tc_chain, test_low_latency_query);
+  tcase_add_test (tc_chain, test_query);
   suite_add_tcase (s, tc_chain);
 
   return s;
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include <string.h>
+#include "gstomx_util.h"
+
+#define LIBRARY_NAME "libomxil-foo.so"
+#define COMPONENT_NAME "OMX.check.dummy"
+
+static OMX_U32
+buffer_count (GOmxCore *core)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+    param.nPortIndex = 0;
+
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+
+    return param.nBufferCountActual;
+}
+
+START_TEST (test_pool_defaults)
+{
+    GOmxCore *core;
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+    OMX_HANDLETYPE omx_handle;
+    OMX_U32 count;
+
+    g_omx_init ();
+    g_omx_set_handle_pool (2, 0);
+
+    core = g_omx_core_new ();
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    count = buffer_count (core);
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+    param.nPortIndex = 0;
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+    param.nBufferCountActual = count + 4;
+    OMX_SetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+
+    omx_handle = core->omx_handle;
+    g_omx_core_deinit (core);
+
+    /* Same component, same role; it comes as it was first. */
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    fail_if (core->omx_handle != omx_handle,
+             "Handle not reused");
+    fail_if (buffer_count (core) != count,
+             "Port not reset");
+
+    g_omx_core_deinit (core);
+
+    /* Another role gets a handle of its own. */
+    g_omx_core_init_role (core, LIBRARY_NAME, COMPONENT_NAME, "dummy");
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+    fail_if (core->omx_handle == omx_handle,
+             "Handle reused for another role");
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+
+    g_omx_set_handle_pool (0, 0);
+    g_omx_deinit ();
+}
+END_TEST
+
+Suite *
+util_suite (void)
+{
+    Suite *s = suite_create ("pool");
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    /* Core test case */
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_pool_defaults);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = util_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
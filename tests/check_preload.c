@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include "gstomx_util.h"
+
+#define LIBRARY_NAME "libomxil-foo.so"
+#define COMPONENT_NAME "OMX.check.dummy"
+
+/* Microseconds the first g_omx_core_init takes. */
+static glong
+first_init (GOmxCore *core)
+{
+    GTimeVal start;
+    GTimeVal end;
+
+    g_get_current_time (&start);
+    g_omx_core_init (core, LIBRARY_NAME, COMPONENT_NAME);
+    g_get_current_time (&end);
+
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    return (end.tv_sec - start.tv_sec) * G_USEC_PER_SEC + (end.tv_usec - start.tv_usec);
+}
+
+START_TEST (test_startup_cold)
+{
+    GOmxCore *core;
+    glong usec;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+
+    usec = first_init (core);
+    fail_if (core->imp->client_count != 1,
+             "Unexpected clients");
+
+    g_print ("cold startup: %ld us\n", usec);
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_startup_preloaded)
+{
+    const gchar *names[] = { LIBRARY_NAME, NULL };
+    GOmxCore *core;
+    glong usec;
+
+    g_omx_init ();
+    g_omx_preload (names);
+    g_omx_preload_wait ();
+
+    core = g_omx_core_new ();
+
+    usec = first_init (core);
+    /* The preloader still holds on to it. */
+    fail_if (core->imp->client_count != 2,
+             "Library not preloaded");
+
+    g_print ("preloaded startup: %ld us\n", usec);
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_startup_racing)
+{
+    const gchar *names[] = { LIBRARY_NAME, NULL };
+    GOmxCore *core;
+
+    /* The element may get there before the preloader is done. */
+    g_omx_init ();
+    g_omx_preload (names);
+
+    core = g_omx_core_new ();
+    first_init (core);
+
+    g_omx_preload_wait ();
+    fail_if (core->imp->client_count != 2,
+             "Unexpected clients");
+
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+END_TEST
+
+Suite *
+util_suite (void)
+{
+    Suite *s = suite_create ("preload");
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    /* Core test case */
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_startup_cold);
+    tcase_add_test (tc_core, test_startup_preloaded);
+    tcase_add_test (tc_core, test_startup_racing);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = util_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
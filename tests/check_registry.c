@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include "gstomx_util.h"
+#include "gstomx_registry.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LIBRARY_NAME "libomxil-foo.so"
+
+static gchar *
+load_cache (GKeyFile *key_file)
+{
+    gchar *file;
+
+    file = g_omx_registry_get_cache_file (LIBRARY_NAME);
+    fail_if (!g_key_file_load_from_file (key_file, file, G_KEY_FILE_NONE, NULL),
+             "No cache file");
+
+    return file;
+}
+
+static void
+save_cache (GKeyFile *key_file,
+            const gchar *file)
+{
+    gchar *data;
+    gsize length;
+
+    data = g_key_file_to_data (key_file, &length, NULL);
+    fail_if (!g_file_set_contents (file, data, length, NULL),
+             "Couldn't write the cache");
+    g_free (data);
+}
+
+START_TEST (test_registry_probe)
+{
+    GOmxRegistry *registry;
+    gchar **roles;
+    gchar **components;
+
+    g_omx_init ();
+
+    registry = g_omx_registry_load (LIBRARY_NAME);
+    fail_if (!registry,
+             "Load failed");
+
+    fail_if (!g_omx_registry_has_component (registry, "OMX.check.dummy"),
+             "Component missing");
+    fail_if (g_omx_registry_has_component (registry, "OMX.check.missing"),
+             "Unexpected component");
+
+    roles = g_omx_registry_get_roles (registry, "OMX.check.dummy");
+    fail_if (!roles || !roles[0] || strcmp (roles[0], "dummy") != 0,
+             "Wrong roles");
+    g_strfreev (roles);
+
+    components = g_omx_registry_get_components_of_role (registry, "dummy");
+    fail_if (g_strv_length (components) != 2,
+             "Wrong components for role");
+    g_strfreev (components);
+
+    g_omx_registry_free (registry);
+
+    /* The ports were probed too. */
+    {
+        GKeyFile *key_file;
+        gchar *file;
+        gchar *direction;
+
+        key_file = g_key_file_new ();
+        file = load_cache (key_file);
+
+        direction = g_key_file_get_string (key_file, "OMX.check.dummy", "port1-direction", NULL);
+        fail_if (!direction || strcmp (direction, "output") != 0,
+                 "Port not probed");
+        g_free (direction);
+
+        g_free (file);
+        g_key_file_free (key_file);
+    }
+
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_registry_cache)
+{
+    GOmxRegistry *registry;
+    GKeyFile *key_file;
+    gchar *file;
+
+    g_omx_init ();
+
+    registry = g_omx_registry_load (LIBRARY_NAME);
+    fail_if (!registry,
+             "Load failed");
+    g_omx_registry_free (registry);
+
+    /* Something the library doesn't have can only come from the cache. */
+    key_file = g_key_file_new ();
+    file = load_cache (key_file);
+    g_key_file_set_string (key_file, "OMX.check.cached", "roles", "dummy");
+    save_cache (key_file, file);
+
+    registry = g_omx_registry_load (LIBRARY_NAME);
+    fail_if (!g_omx_registry_has_component (registry, "OMX.check.cached"),
+             "Cache not used");
+    g_omx_registry_free (registry);
+
+    /* As if the library had been replaced. */
+    g_key_file_set_string (key_file, "library", "mtime", "1");
+    save_cache (key_file, file);
+
+    registry = g_omx_registry_load (LIBRARY_NAME);
+    fail_if (g_omx_registry_has_component (registry, "OMX.check.cached"),
+             "Stale cache used");
+    fail_if (!g_omx_registry_has_component (registry, "OMX.check.dummy"),
+             "Component missing");
+    g_omx_registry_free (registry);
+
+    g_free (file);
+    g_key_file_free (key_file);
+
+    g_omx_deinit ();
+}
+END_TEST
+
+START_TEST (test_registry_registration)
+{
+    GOmxRegistry *registry;
+    GKeyFile *key_file;
+    gchar *file;
+    gchar *registration;
+    gchar **files;
+    guint i;
+    gboolean found = FALSE;
+
+    registration = g_build_filename (g_getenv ("XDG_CACHE_HOME"), "omxregister", NULL);
+    g_setenv ("OMX_BELLAGIO_REGISTRY", registration, TRUE);
+
+    g_omx_init ();
+
+    registry = g_omx_registry_load (LIBRARY_NAME);
+    fail_if (!registry,
+             "Load failed");
+
+    files = g_omx_registry_get_files (registry);
+    for (i = 0; files[i]; i++)
+        found |= (strcmp (files[i], registration) == 0);
+    fail_if (!found,
+             "Registration file not a dependency");
+    g_strfreev (files);
+
+    g_omx_registry_free (registry);
+
+    key_file = g_key_file_new ();
+    file = load_cache (key_file);
+    g_key_file_set_string (key_file, "OMX.check.cached", "roles", "dummy");
+    save_cache (key_file, file);
+
+    /* A component gets registered. */
+    fail_if (!g_file_set_contents (registration, "OMX.check.cached\n", -1, NULL),
+             "Couldn't write the registration file");
+
+    registry = g_omx_registry_load (LIBRARY_NAME);
+    fail_if (g_omx_registry_has_component (registry, "OMX.check.cached"),
+             "Stale cache used");
+    g_omx_registry_free (registry);
+
+    g_unlink (registration);
+    g_unsetenv ("OMX_BELLAGIO_REGISTRY");
+
+    g_free (registration);
+    g_free (file);
+    g_key_file_free (key_file);
+
+    g_omx_deinit ();
+}
+END_TEST
+
+Suite *
+util_suite (void)
+{
+    Suite *s = suite_create ("registry");
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    /* Keep the cache away from the user's. */
+    {
+        static gchar dir[] = "/tmp/check_registry-XXXXXX";
+        fail_if (!mkdtemp (dir));
+        g_setenv ("XDG_CACHE_HOME", dir, TRUE);
+    }
+
+    /* Core test case */
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_registry_probe);
+    tcase_add_test (tc_core, test_registry_cache);
+    tcase_add_test (tc_core, test_registry_registration);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = util_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include <string.h>
+#include "gstomx_util.h"
+
+#define LIBRARY_NAME "libomxil-foo.so"
+#define COMPONENT_NAME "OMX.check.dummy"
+#define STUCK_COMPONENT_NAME "OMX.check.stuck"
+
+/* Microseconds. */
+#define TIMEOUT 20000
+
+static volatile gint stalls;
+
+static void
+stalled_cb (GOmxCore *core)
+{
+    g_atomic_int_inc (&stalls);
+}
+
+static GOmxCore *
+start_core (const gchar *component_name,
+            GOmxPort **in_port,
+            GOmxPort **out_port)
+{
+    GOmxCore *core;
+    OMX_PARAM_PORTDEFINITIONTYPE param;
+
+    g_omx_init ();
+    core = g_omx_core_new ();
+    core->timeout = TIMEOUT;
+    core->stalled_cb = stalled_cb;
+    g_atomic_int_set (&stalls, 0);
+
+    g_omx_core_init (core, LIBRARY_NAME, component_name);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Init failed");
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (param);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+
+    param.nPortIndex = 0;
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+    *in_port = g_omx_core_setup_port (core, &param);
+
+    param.nPortIndex = 1;
+    OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, &param);
+    *out_port = g_omx_core_setup_port (core, &param);
+
+    g_omx_core_prepare (core);
+    g_omx_core_start (core);
+    fail_if (core->omx_error != OMX_ErrorNone,
+             "Start failed");
+
+    /* The component gets the output buffers, like a filter does. */
+    g_omx_port_release_buffer (*out_port, g_omx_port_request_buffer (*out_port));
+
+    return core;
+}
+
+static void
+stop_core (GOmxCore *core,
+           GOmxPort *in_port,
+           GOmxPort *out_port)
+{
+    g_omx_port_finish (in_port);
+    g_omx_port_finish (out_port);
+    g_omx_core_finish (core);
+    g_omx_core_deinit (core);
+    g_omx_core_free (core);
+    g_omx_deinit ();
+}
+
+START_TEST (test_watchdog_idle)
+{
+    GOmxCore *core;
+    GOmxPort *in_port;
+    GOmxPort *out_port;
+
+    core = start_core (COMPONENT_NAME, &in_port, &out_port);
+
+    /* Holding output buffers while there's no input is no stall. */
+    g_usleep (TIMEOUT * 5);
+    fail_if (g_atomic_int_get (&stalls) != 0,
+             "Idle component reported as stalled");
+
+    stop_core (core, in_port, out_port);
+}
+END_TEST
+
+START_TEST (test_watchdog_stuck)
+{
+    GOmxCore *core;
+    GOmxPort *in_port;
+    GOmxPort *out_port;
+    OMX_BUFFERHEADERTYPE *omx_buffer;
+
+    core = start_core (STUCK_COMPONENT_NAME, &in_port, &out_port);
+    core->reset_on_stall = TRUE;
+
+    omx_buffer = g_omx_port_request_buffer (in_port);
+    omx_buffer->nFilledLen = 1;
+    g_omx_port_release_buffer (in_port, omx_buffer);
+
+    g_usleep (TIMEOUT * 5);
+    fail_if (g_atomic_int_get (&stalls) != 1,
+             "Stall not reported once");
+
+    /* The reset got the input back, and didn't leave anything for the
+     * next flush to find. */
+    fail_if (g_atomic_int_get (&in_port->component_buffers) != 0,
+             "Input not flushed");
+    fail_if (g_omx_sem_down_timed (core->flush_sem, TIMEOUT),
+             "Reset completion left behind");
+
+    stop_core (core, in_port, out_port);
+}
+END_TEST
+
+Suite *
+util_suite (void)
+{
+    Suite *s = suite_create ("watchdog");
+
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    /* Core test case */
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_watchdog_idle);
+    tcase_add_test (tc_core, test_watchdog_stuck);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = util_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
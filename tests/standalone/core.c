@@ -23,9 +23,14 @@
 #include <OMX_Component.h>
 
 #include <glib.h>
+#include <string.h>
 
 #include "async_queue.h"
 
+/* Any name works with OMX_GetHandle; these are the ones we admit to. */
+static const char *component_names[] = { "OMX.check.dummy", "OMX.st.dummy", NULL };
+static const char *component_role = "dummy";
+
 static void *foo_thread (void *cb_data);
 
 OMX_ERRORTYPE
@@ -56,6 +61,13 @@ struct CompPrivate
     CompPrivatePort *ports;
     gboolean done;
     GMutex *flush_mutex;
+    gboolean no_allocate; /**< Refuse OMX_AllocateBuffer. */
+    guint allocate_limit; /**< Run out after this many allocations; 0 for never. */
+    guint allocated;
+    gboolean stuck; /**< Take buffers, but never process them. */
+    gboolean sync; /**< Give output buffers back from inside FillThisBuffer. */
+    gboolean frames; /**< Only output whole frames; drop the rest. */
+    gulong delay; /**< Microseconds each buffer takes. */
 };
 
 struct CompPrivatePort
@@ -100,9 +112,19 @@ comp_GetParameter (OMX_HANDLETYPE handle,
             {
                 OMX_PARAM_PORTDEFINITIONTYPE *port_def;
                 port_def = param;
+                if (port_def->nPortIndex >= 2)
+                    return OMX_ErrorBadPortIndex;
                 memcpy (port_def, &private->ports[port_def->nPortIndex].port_def, port_def->nSize);
                 break;
             }
+        case OMX_IndexParamAudioInit:
+            {
+                OMX_PORT_PARAM_TYPE *port_param;
+                port_param = param;
+                port_param->nPorts = 2;
+                port_param->nStartPortNumber = 0;
+                break;
+            }
         default:
             break;
     }
@@ -129,9 +151,19 @@ comp_SetParameter (OMX_HANDLETYPE handle,
             {
                 OMX_PARAM_PORTDEFINITIONTYPE *port_def;
                 port_def = param;
+                if (port_def->nPortIndex >= 2)
+                    return OMX_ErrorBadPortIndex;
                 memcpy (&private->ports[port_def->nPortIndex].port_def, port_def, port_def->nSize);
                 break;
             }
+        case OMX_IndexParamStandardComponentRole:
+            {
+                OMX_PARAM_COMPONENTROLETYPE *role;
+                role = param;
+                if (strcmp ((char *) role->cRole, component_role) != 0)
+                    return OMX_ErrorBadParameter;
+                break;
+            }
         default:
             break;
     }
@@ -157,7 +189,8 @@ comp_SendCommand (OMX_HANDLETYPE handle,
     {
         case OMX_CommandStateSet:
             {
-                if (private->state == OMX_StateLoaded && param_1 == OMX_StateIdle)
+                if (private->state == OMX_StateLoaded && param_1 == OMX_StateIdle &&
+                    !private->stuck)
                 {
                     g_thread_create (foo_thread, comp, TRUE, NULL);
                 }
@@ -228,11 +261,47 @@ comp_UseBuffer (OMX_HANDLETYPE handle,
     return OMX_ErrorNone;
 }
 
+static OMX_ERRORTYPE
+comp_AllocateBuffer (OMX_HANDLETYPE handle,
+                     OMX_BUFFERHEADERTYPE **buffer_header,
+                     OMX_U32 index,
+                     OMX_PTR data,
+                     OMX_U32 size)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+    OMX_ERRORTYPE error;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    if (private->no_allocate)
+        return OMX_ErrorNotImplemented;
+
+    if (private->allocate_limit && private->allocated >= private->allocate_limit)
+        return OMX_ErrorInsufficientResources;
+
+    private->allocated++;
+
+    error = comp_UseBuffer (handle, buffer_header, index, data, size, malloc (size));
+
+    /* Remember what's ours; the client must give it back untouched. */
+    (*buffer_header)->pPlatformPrivate = (*buffer_header)->pBuffer;
+
+    return error;
+}
+
 static OMX_ERRORTYPE
 comp_FreeBuffer (OMX_HANDLETYPE handle,
                  OMX_U32 index,
                  OMX_BUFFERHEADERTYPE *buffer_header)
 {
+    if (buffer_header->pPlatformPrivate)
+    {
+        g_assert (buffer_header->pBuffer == buffer_header->pPlatformPrivate);
+        free (buffer_header->pPlatformPrivate);
+    }
+
     free (buffer_header);
 
     return OMX_ErrorNone;
@@ -255,6 +324,21 @@ foo_thread (gpointer cb_data)
         in_buffer = async_queue_pop (private->ports[0].queue);
         if (!in_buffer) continue;
 
+        /* Like a decoder that waits for the end of the frame. */
+        if (private->frames &&
+            !(in_buffer->nFlags & (OMX_BUFFERFLAG_ENDOFFRAME | OMX_BUFFERFLAG_EOS)))
+        {
+            in_buffer->nFilledLen = 0;
+            g_mutex_lock (private->flush_mutex);
+            private->callbacks->EmptyBufferDone (comp,
+                                                 private->app_data, in_buffer);
+            g_mutex_unlock (private->flush_mutex);
+            continue;
+        }
+
+        if (private->delay)
+            g_usleep (private->delay);
+
         out_buffer = async_queue_pop (private->ports[1].queue);
         if (!out_buffer) continue;
 
@@ -314,6 +398,12 @@ comp_FillThisBuffer (OMX_HANDLETYPE handle,
     comp = handle;
     private = comp->pComponentPrivate;
 
+    if (private->sync && private->state == OMX_StateExecuting)
+    {
+        private->callbacks->FillBufferDone (comp, private->app_data, buffer_header);
+        return OMX_ErrorNone;
+    }
+
     async_queue_push (private->ports[1].queue, buffer_header);
 
     return OMX_ErrorNone;
@@ -327,6 +417,10 @@ OMX_GetHandle (OMX_HANDLETYPE *handle,
 {
     OMX_COMPONENTTYPE *comp;
 
+    /* Pretends to be full, so the callers look elsewhere. */
+    if (strcmp (component_name, "OMX.check.busy") == 0)
+        return OMX_ErrorInsufficientResources;
+
     comp = calloc (1, sizeof (OMX_COMPONENTTYPE));
     comp->nSize = sizeof (OMX_COMPONENTTYPE);
     comp->nVersion.nVersion = 1;
@@ -336,6 +430,7 @@ OMX_GetHandle (OMX_HANDLETYPE *handle,
     comp->SetParameter = comp_SetParameter;
     comp->SendCommand = comp_SendCommand;
     comp->UseBuffer = comp_UseBuffer;
+    comp->AllocateBuffer = comp_AllocateBuffer;
     comp->FreeBuffer = comp_FreeBuffer;
     comp->EmptyThisBuffer = comp_EmptyThisBuffer;
     comp->FillThisBuffer = comp_FillThisBuffer;
@@ -349,6 +444,14 @@ OMX_GetHandle (OMX_HANDLETYPE *handle,
         private->app_data = data;
         private->ports = calloc (2, sizeof (CompPrivatePort));
         private->flush_mutex = g_mutex_new ();
+        private->no_allocate = (strcmp (component_name, "OMX.check.use_buffer") == 0);
+        if (strcmp (component_name, "OMX.check.allocate_two") == 0)
+            private->allocate_limit = 2;
+        private->stuck = (strcmp (component_name, "OMX.check.stuck") == 0);
+        private->sync = (strcmp (component_name, "OMX.check.sync") == 0);
+        private->frames = (strcmp (component_name, "OMX.check.frames") == 0);
+        if (strcmp (component_name, "OMX.check.slow") == 0)
+            private->delay = 10000;
 
         private->ports[0].queue = async_queue_new ();
         private->ports[1].queue = async_queue_new ();
@@ -396,3 +499,54 @@ OMX_FreeHandle (OMX_HANDLETYPE handle)
     /** @todo Free private structure? */
     return OMX_ErrorNone;
 }
+
+OMX_ERRORTYPE
+OMX_ComponentNameEnum (OMX_STRING name,
+                       OMX_U32 length,
+                       OMX_U32 index)
+{
+    if (index >= G_N_ELEMENTS (component_names) - 1)
+        return OMX_ErrorNoMore;
+
+    strncpy (name, component_names[index], length);
+    name[length - 1] = '\0';
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_GetRolesOfComponent (OMX_STRING name,
+                         OMX_U32 *num_roles,
+                         OMX_U8 **roles)
+{
+    if (roles && *num_roles >= 1)
+        strcpy ((char *) roles[0], component_role);
+
+    *num_roles = 1;
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_GetComponentsOfRole (OMX_STRING role,
+                         OMX_U32 *num_components,
+                         OMX_U8 **names)
+{
+    OMX_U32 count;
+
+    if (strcmp (role, component_role) != 0)
+    {
+        *num_components = 0;
+        return OMX_ErrorNone;
+    }
+
+    for (count = 0; component_names[count]; count++)
+    {
+        if (names && count < *num_components)
+            strcpy ((char *) names[count], component_names[count]);
+    }
+
+    *num_components = count;
+
+    return OMX_ErrorNone;
+}
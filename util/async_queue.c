@@ -19,10 +19,241 @@
  *
  */
 
+#include "config.h"
+
 #include <glib.h>
 
 #include "async_queue.h"
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Bounded queues are a lock-free ring with one producer and one consumer; the
+ * mutex is only taken by a consumer that has to sleep, by a producer that has
+ * to wake it up, and to change the enabled state.
+ */
+
+static inline guint
+ring_length (AsyncQueue *queue)
+{
+    return (guint) (g_atomic_int_get (&queue->write_index) -
+                    g_atomic_int_get (&queue->read_index));
+}
+
+static inline gboolean
+ring_push (AsyncQueue *queue,
+           gpointer data)
+{
+    gint index;
+
+    index = queue->write_index;
+
+    if (G_UNLIKELY ((guint) (index - g_atomic_int_get (&queue->read_index)) > queue->ring_mask))
+        return FALSE;
+
+    queue->ring[index & queue->ring_mask] = data;
+    g_atomic_int_inc (&queue->write_index);
+
+    return TRUE;
+}
+
+static inline gpointer
+ring_pop (AsyncQueue *queue)
+{
+    gpointer data;
+    gint index;
+
+    index = queue->read_index;
+
+    if (index == g_atomic_int_get (&queue->write_index))
+        return NULL;
+
+    data = queue->ring[index & queue->ring_mask];
+    g_atomic_int_inc (&queue->read_index);
+
+    return data;
+}
+
+static gboolean
+ring_ready (gpointer data)
+{
+    AsyncQueue *queue;
+
+    queue = data;
+
+    return !g_atomic_int_get (&queue->enabled) || ring_length (queue) > 0;
+}
+
+/* Consumer side, without taking the mutex; spins for a while if enabled. */
+static inline gpointer
+ring_pop_spin (AsyncQueue *queue)
+{
+    gpointer data;
+
+    if (G_UNLIKELY (!g_atomic_int_get (&queue->enabled)))
+        return NULL;
+
+    data = ring_pop (queue);
+
+    if (G_LIKELY (data) ||
+        !spin_wait (&queue->spin, ring_ready, queue))
+        return data;
+
+    if (G_UNLIKELY (!g_atomic_int_get (&queue->enabled)))
+        return NULL;
+
+    return ring_pop (queue);
+}
+
+/*
+ * Watermarks: the state flips under the mutex when the length reaches the
+ * high watermark, and again once it is back down to the low one; func is
+ * told afterwards, with the mutex released. Whoever flips the state also
+ * delivers it, and deliveries are serialized by watermark_mutex, each
+ * reporting the latest state; so func never runs twice at once, and never
+ * ends up with a stale state, even when pushes and pops race.
+ */
+
+static void
+watermark_update (AsyncQueue *queue)
+{
+    g_mutex_lock (queue->watermark_mutex);
+
+    while (TRUE)
+    {
+        AsyncQueueWatermarkFunc func;
+        gpointer data;
+        gboolean above;
+
+        g_mutex_lock (queue->mutex);
+
+        func = queue->watermark_func;
+        data = queue->watermark_data;
+
+        if (func)
+        {
+            guint length;
+
+            length = queue->ring ? ring_length (queue) : queue->length;
+
+            if (!queue->above && length >= queue->high_watermark)
+                g_atomic_int_set (&queue->above, TRUE);
+            else if (queue->above && length <= queue->low_watermark)
+                g_atomic_int_set (&queue->above, FALSE);
+        }
+
+        above = queue->above;
+
+        g_mutex_unlock (queue->mutex);
+
+        if (!func || above == queue->reported)
+            break;
+
+        queue->reported = above;
+        func (queue, above, data);
+    }
+
+    g_mutex_unlock (queue->watermark_mutex);
+}
+
+static inline void
+watermark_check (AsyncQueue *queue)
+{
+    guint length;
+    gboolean above;
+
+    if (G_LIKELY (!queue->watermark_func))
+        return;
+
+    /* Unlocked first look; only take the mutex near a crossing. */
+    length = queue->ring ? ring_length (queue) : queue->length;
+    above = g_atomic_int_get (&queue->above);
+
+    if ((!above && length >= queue->high_watermark) ||
+        (above && length <= queue->low_watermark))
+    {
+        watermark_update (queue);
+    }
+}
+
+/*
+ * Statistics; the counters only have one writer, either because the queue
+ * is bounded or because the mutex is held.
+ */
+
+static inline void
+pushed (AsyncQueue *queue,
+        guint length)
+{
+    queue->stats.pushes++;
+    if (length > queue->stats.max_length)
+        queue->stats.max_length = length;
+}
+
+static inline void
+popped (AsyncQueue *queue,
+        guint count)
+{
+    if (G_LIKELY (count))
+        queue->stats.pops += count;
+    else if (!g_atomic_int_get (&queue->enabled))
+        queue->stats.disabled_pops++;
+
+    watermark_check (queue);
+}
+
+static inline void
+fd_signal (AsyncQueue *queue)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    gint fd;
+
+    fd = g_atomic_int_get (&queue->fd);
+    if (fd >= 0)
+        eventfd_write (fd, 1);
+#endif
+}
+
+static inline void
+fd_clear (AsyncQueue *queue)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    gint fd;
+
+    fd = g_atomic_int_get (&queue->fd);
+    if (fd >= 0)
+    {
+        eventfd_t value;
+        eventfd_read (fd, &value);
+    }
+#endif
+}
+
+static inline gpointer
+list_pop (AsyncQueue *queue)
+{
+    gpointer data = NULL;
+
+    if (queue->tail)
+    {
+        GList *node = queue->tail;
+        data = node->data;
+
+        queue->tail = node->prev;
+        if (queue->tail)
+            queue->tail->next = NULL;
+        else
+            queue->head = NULL;
+        queue->length--;
+        g_list_free_1 (node);
+    }
+
+    return data;
+}
+
 AsyncQueue *
 async_queue_new (void)
 {
@@ -32,7 +263,26 @@ async_queue_new (void)
 
     queue->condition = g_cond_new ();
     queue->mutex = g_mutex_new ();
+    queue->watermark_mutex = g_mutex_new ();
     queue->enabled = TRUE;
+    queue->fd = -1;
+
+    return queue;
+}
+
+AsyncQueue *
+async_queue_new_bounded (guint capacity)
+{
+    AsyncQueue *queue;
+    guint size;
+
+    queue = async_queue_new ();
+
+    /* Round up to a power of two so the indexes can wrap around freely. */
+    for (size = 1; size < capacity; size <<= 1);
+
+    queue->ring = g_new0 (gpointer, size);
+    queue->ring_mask = size - 1;
 
     return queue;
 }
@@ -42,7 +292,14 @@ async_queue_free (AsyncQueue *queue)
 {
     g_cond_free (queue->condition);
     g_mutex_free (queue->mutex);
+    g_mutex_free (queue->watermark_mutex);
 
+#ifdef HAVE_SYS_EVENTFD_H
+    if (queue->fd >= 0)
+        close (queue->fd);
+#endif
+
+    g_free (queue->ring);
     g_list_free (queue->head);
     g_slice_free (AsyncQueue, queue);
 }
@@ -51,16 +308,81 @@ void
 async_queue_push (AsyncQueue *queue,
                   gpointer data)
 {
+    if (queue->ring)
+    {
+        if (G_UNLIKELY (!ring_push (queue, data)))
+        {
+            g_warning ("queue overflow; capacity is %u", queue->ring_mask + 1);
+            return;
+        }
+
+        pushed (queue, ring_length (queue));
+
+        fd_signal (queue);
+
+        if (g_atomic_int_get (&queue->waiting))
+        {
+            g_mutex_lock (queue->mutex);
+            g_cond_signal (queue->condition);
+            g_mutex_unlock (queue->mutex);
+        }
+
+        watermark_check (queue);
+
+        return;
+    }
+
     g_mutex_lock (queue->mutex);
 
     queue->head = g_list_prepend (queue->head, data);
     if (!queue->tail)
         queue->tail = queue->head;
     queue->length++;
+    pushed (queue, queue->length);
 
     g_cond_signal (queue->condition);
 
     g_mutex_unlock (queue->mutex);
+
+    fd_signal (queue);
+
+    watermark_check (queue);
+}
+
+static gpointer
+ring_pop_wait (AsyncQueue *queue)
+{
+    gpointer data;
+
+    data = ring_pop_spin (queue);
+    if (G_LIKELY (data))
+        return data;
+
+    g_mutex_lock (queue->mutex);
+
+    g_atomic_int_inc (&queue->waiting);
+
+    if (queue->enabled &&
+        !(data = ring_pop (queue)))
+    {
+        GTimeVal start;
+
+        g_get_current_time (&start);
+
+        while (queue->enabled &&
+               !(data = ring_pop (queue)))
+        {
+            g_cond_wait (queue->condition, queue->mutex);
+        }
+
+        wait_stats_add (&queue->stats.waits, &start);
+    }
+
+    g_atomic_int_add (&queue->waiting, -1);
+
+    g_mutex_unlock (queue->mutex);
+
+    return data;
 }
 
 gpointer
@@ -68,6 +390,13 @@ async_queue_pop (AsyncQueue *queue)
 {
     gpointer data = NULL;
 
+    if (queue->ring)
+    {
+        data = ring_pop_wait (queue);
+        popped (queue, data != NULL);
+        return data;
+    }
+
     g_mutex_lock (queue->mutex);
 
     if (!queue->enabled)
@@ -78,26 +407,84 @@ async_queue_pop (AsyncQueue *queue)
 
     if (!queue->tail)
     {
+        GTimeVal start;
+
+        g_get_current_time (&start);
         g_cond_wait (queue->condition, queue->mutex);
+        wait_stats_add (&queue->stats.waits, &start);
     }
 
-    if (queue->tail)
+    data = list_pop (queue);
+
+leave:
+    g_mutex_unlock (queue->mutex);
+
+    popped (queue, data != NULL);
+
+    return data;
+}
+
+/**
+ * Like async_queue_pop(), but gives up after timeout microseconds and
+ * returns NULL.
+ */
+gpointer
+async_queue_pop_timed (AsyncQueue *queue,
+                       gulong timeout)
+{
+    gpointer data = NULL;
+    GTimeVal start;
+    GTimeVal end_time;
+    gboolean waited = FALSE;
+
+    if (queue->ring)
     {
-        GList *node = queue->tail;
-        data = node->data;
+        data = ring_pop_spin (queue);
+        if (G_LIKELY (data))
+            goto leave;
+    }
 
-        queue->tail = node->prev;
-        if (queue->tail)
-            queue->tail->next = NULL;
-        else
-            queue->head = NULL;
-        queue->length--;
-        g_list_free_1 (node);
+    g_get_current_time (&start);
+    end_time = start;
+    g_time_val_add (&end_time, timeout);
+
+    g_mutex_lock (queue->mutex);
+
+    if (queue->ring)
+    {
+        g_atomic_int_inc (&queue->waiting);
+
+        while (queue->enabled &&
+               !(data = ring_pop (queue)))
+        {
+            waited = TRUE;
+            if (!g_cond_timed_wait (queue->condition, queue->mutex, &end_time))
+                break;
+        }
+
+        g_atomic_int_add (&queue->waiting, -1);
     }
+    else
+    {
+        while (queue->enabled && !queue->tail)
+        {
+            waited = TRUE;
+            if (!g_cond_timed_wait (queue->condition, queue->mutex, &end_time))
+                break;
+        }
+
+        if (queue->enabled)
+            data = list_pop (queue);
+    }
+
+    if (waited)
+        wait_stats_add (&queue->stats.waits, &start);
 
-leave:
     g_mutex_unlock (queue->mutex);
 
+leave:
+    popped (queue, data != NULL);
+
     return data;
 }
 
@@ -106,32 +493,92 @@ async_queue_pop_forced (AsyncQueue *queue)
 {
     gpointer data = NULL;
 
+    if (queue->ring)
+    {
+        data = ring_pop (queue);
+    }
+    else
+    {
+        g_mutex_lock (queue->mutex);
+        data = list_pop (queue);
+        g_mutex_unlock (queue->mutex);
+    }
+
+    /* An empty queue isn't a disabled pop here. */
+    if (data)
+        queue->stats.pops++;
+
+    watermark_check (queue);
+
+    return data;
+}
+
+/**
+ * Waits like async_queue_pop() for the first item, then takes whatever else
+ * is ready, up to max items. Returns the number of items stored in data,
+ * zero if the queue is disabled.
+ */
+guint
+async_queue_pop_many (AsyncQueue *queue,
+                      gpointer *data,
+                      guint max)
+{
+    guint count = 0;
+
+    if (G_UNLIKELY (max == 0))
+        return 0;
+
+    if (queue->ring)
+    {
+        data[0] = ring_pop_wait (queue);
+        if (data[0])
+        {
+            for (count = 1; count < max; count++)
+            {
+                data[count] = ring_pop (queue);
+                if (!data[count])
+                    break;
+            }
+        }
+
+        popped (queue, count);
+
+        return count;
+    }
+
     g_mutex_lock (queue->mutex);
 
-    if (queue->tail)
+    if (queue->enabled && !queue->tail)
     {
-        GList *node = queue->tail;
-        data = node->data;
+        GTimeVal start;
 
-        queue->tail = node->prev;
-        if (queue->tail)
-            queue->tail->next = NULL;
-        else
-            queue->head = NULL;
-        queue->length--;
-        g_list_free_1 (node);
+        g_get_current_time (&start);
+
+        while (queue->enabled && !queue->tail)
+        {
+            g_cond_wait (queue->condition, queue->mutex);
+        }
+
+        wait_stats_add (&queue->stats.waits, &start);
+    }
+
+    while (queue->enabled && count < max && queue->tail)
+    {
+        data[count++] = list_pop (queue);
     }
 
     g_mutex_unlock (queue->mutex);
 
-    return data;
+    popped (queue, count);
+
+    return count;
 }
 
 void
 async_queue_disable (AsyncQueue *queue)
 {
     g_mutex_lock (queue->mutex);
-    queue->enabled = FALSE;
+    g_atomic_int_set (&queue->enabled, FALSE);
     g_cond_broadcast (queue->condition);
     g_mutex_unlock (queue->mutex);
 }
@@ -140,6 +587,155 @@ void
 async_queue_enable (AsyncQueue *queue)
 {
     g_mutex_lock (queue->mutex);
-    queue->enabled = TRUE;
+    g_atomic_int_set (&queue->enabled, TRUE);
+    g_mutex_unlock (queue->mutex);
+
+    /* Whatever is left from before must be noticed by pollers again. */
+    if (async_queue_length (queue) > 0)
+        fd_signal (queue);
+}
+
+/**
+ * Makes the consumer of a bounded queue busy-wait for up to max iterations
+ * before going to sleep, which trades CPU time for wakeup latency. Zero,
+ * the default, disables it. Unbounded queues always sleep right away.
+ */
+void
+async_queue_set_spin (AsyncQueue *queue,
+                      guint max)
+{
+    spin_wait_init (&queue->spin, max);
+}
+
+/**
+ * Calls func (with high set) when the queue fills up to high items, and
+ * then (with high unset) when it drains down to low again. func is called
+ * from whichever thread pushed or popped, after the queue is unlocked; it
+ * may use the queue, but must not change the watermarks. Calls never
+ * overlap. A high of zero removes the watermarks.
+ */
+void
+async_queue_set_watermarks (AsyncQueue *queue,
+                            guint low,
+                            guint high,
+                            AsyncQueueWatermarkFunc func,
+                            gpointer data)
+{
+    g_mutex_lock (queue->watermark_mutex);
+    g_mutex_lock (queue->mutex);
+
+    /* low must stay below high, or the state would flip back and forth. */
+    queue->low_watermark = high ? MIN (low, high - 1) : 0;
+    queue->high_watermark = high;
+    queue->watermark_data = data;
+    queue->watermark_func = high ? func : NULL;
+    g_atomic_int_set (&queue->above, FALSE);
+    queue->reported = FALSE;
+
+    g_mutex_unlock (queue->mutex);
+    g_mutex_unlock (queue->watermark_mutex);
+
+    watermark_update (queue);
+}
+
+/**
+ * Copies the statistics gathered since the queue was created, with the
+ * current length filled in.
+ */
+void
+async_queue_get_stats (AsyncQueue *queue,
+                       AsyncQueueStats *stats)
+{
+    g_mutex_lock (queue->mutex);
+    *stats = queue->stats;
+    stats->length = queue->ring ? ring_length (queue) : queue->length;
+    g_mutex_unlock (queue->mutex);
+}
+
+guint
+async_queue_length (AsyncQueue *queue)
+{
+    guint length;
+
+    if (queue->ring)
+        return ring_length (queue);
+
+    g_mutex_lock (queue->mutex);
+    length = queue->length;
     g_mutex_unlock (queue->mutex);
+
+    return length;
+}
+
+/**
+ * Returns a file descriptor that polls readable while there might be items
+ * in the queue, or -1 if that's not supported. The consumer must use
+ * async_queue_try_pop_many(), which clears it.
+ */
+gint
+async_queue_get_fd (AsyncQueue *queue)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    g_mutex_lock (queue->mutex);
+
+    if (queue->fd < 0)
+    {
+        gint fd;
+
+        fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+        g_atomic_int_set (&queue->fd, fd);
+
+        if (fd >= 0 && (queue->ring ? ring_length (queue) : queue->length) > 0)
+            fd_signal (queue);
+    }
+
+    g_mutex_unlock (queue->mutex);
+
+    return queue->fd;
+#else
+    return -1;
+#endif
+}
+
+/**
+ * Takes up to max items without waiting. Returns zero if the queue is empty
+ * or disabled.
+ */
+guint
+async_queue_try_pop_many (AsyncQueue *queue,
+                          gpointer *data,
+                          guint max)
+{
+    guint count = 0;
+
+    /* Clear before looking, so a push that comes later signals again. */
+    fd_clear (queue);
+
+    if (queue->ring)
+    {
+        if (g_atomic_int_get (&queue->enabled))
+        {
+            while (count < max &&
+                   (data[count] = ring_pop (queue)))
+                count++;
+        }
+    }
+    else
+    {
+        g_mutex_lock (queue->mutex);
+
+        while (queue->enabled && count < max && queue->tail)
+        {
+            data[count++] = list_pop (queue);
+        }
+
+        g_mutex_unlock (queue->mutex);
+    }
+
+    if (count == max && async_queue_length (queue) > 0)
+        fd_signal (queue);
+
+    popped (queue, count);
+
+    return count;
 }
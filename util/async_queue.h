@@ -24,7 +24,22 @@
 
 #include <glib.h>
 
+#include "spin_wait.h"
+#include "wait_stats.h"
+
 typedef struct AsyncQueue AsyncQueue;
+typedef struct AsyncQueueStats AsyncQueueStats;
+typedef void (*AsyncQueueWatermarkFunc) (AsyncQueue *queue, gboolean high, gpointer data);
+
+struct AsyncQueueStats
+{
+    guint pushes;
+    guint pops;
+    guint disabled_pops; /**< Pops that returned nothing because of a disable. */
+    guint length;
+    guint max_length;
+    WaitStats waits; /**< Pops that found the queue empty and blocked. */
+};
 
 struct AsyncQueue
 {
@@ -34,14 +49,43 @@ struct AsyncQueue
     GList *tail;
     guint length;
     gboolean enabled;
+
+    /* Bounded queues; single producer, single consumer. */
+    gpointer *ring;
+    guint ring_mask;
+    volatile gint read_index; /**< Only written by the consumer. */
+    volatile gint write_index; /**< Only written by the producer. */
+    volatile gint waiting;
+    SpinWait spin; /**< Before sleeping in pop; see async_queue_set_spin(). */
+
+    guint low_watermark;
+    guint high_watermark;
+    volatile gint above; /**< Crossed high_watermark, not yet back to low. */
+    AsyncQueueWatermarkFunc watermark_func;
+    gpointer watermark_data;
+    GMutex *watermark_mutex; /**< Serializes calls to watermark_func. */
+    gboolean reported; /**< What watermark_func was last told; watermark_mutex. */
+
+    AsyncQueueStats stats;
+
+    volatile gint fd; /**< eventfd signalled on push; -1 if not pollable. */
 };
 
 AsyncQueue *async_queue_new (void);
+AsyncQueue *async_queue_new_bounded (guint capacity);
 void async_queue_free (AsyncQueue *queue);
 void async_queue_push (AsyncQueue *queue, gpointer data);
 gpointer async_queue_pop (AsyncQueue *queue);
+gpointer async_queue_pop_timed (AsyncQueue *queue, gulong timeout);
 gpointer async_queue_pop_forced (AsyncQueue *queue);
+guint async_queue_pop_many (AsyncQueue *queue, gpointer *data, guint max);
 void async_queue_disable (AsyncQueue *queue);
 void async_queue_enable (AsyncQueue *queue);
+guint async_queue_length (AsyncQueue *queue);
+void async_queue_get_stats (AsyncQueue *queue, AsyncQueueStats *stats);
+gint async_queue_get_fd (AsyncQueue *queue);
+guint async_queue_try_pop_many (AsyncQueue *queue, gpointer *data, guint max);
+void async_queue_set_spin (AsyncQueue *queue, guint max);
+void async_queue_set_watermarks (AsyncQueue *queue, guint low, guint high, AsyncQueueWatermarkFunc func, gpointer data);
 
 #endif /* ASYNC_QUEUE_H */
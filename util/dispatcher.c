@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "dispatcher.h"
+
+#if defined (HAVE_SYS_EPOLL_H) && defined (HAVE_SYS_EVENTFD_H)
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define MAX_EVENTS 32
+
+typedef struct Loop Loop;
+typedef struct Watch Watch;
+
+struct Loop
+{
+    Dispatcher *dispatcher;
+    GThread *thread;
+    gint epoll_fd;
+    gint wakeup_fd;
+    GList *dead; /**< Removed watches, freed by the loop itself. */
+    gboolean quit;
+};
+
+struct Watch
+{
+    gint fd;
+    DispatcherFunc func;
+    gpointer data;
+    Loop *loop;
+    gboolean removed;
+    gboolean running; /**< Handed to the pool; fd is disarmed meanwhile. */
+    GThread *thread; /**< Running the callback, if any. */
+    gboolean free_on_return; /**< Removed from its own callback. */
+};
+
+struct Dispatcher
+{
+    GMutex *mutex;
+    GCond *condition; /**< Signalled whenever a callback returns. */
+    GHashTable *watches;
+    Loop *loops;
+    guint n_loops;
+    guint next_loop;
+    GThreadPool *pool; /**< Runs the callbacks, so they may block. */
+};
+
+/** Runs a watch's callback on a pool thread, then arms fd again. */
+static void
+run_watch (gpointer data,
+           gpointer user_data)
+{
+    Watch *watch;
+    Dispatcher *dispatcher;
+
+    watch = data;
+    dispatcher = user_data;
+
+    g_mutex_lock (dispatcher->mutex);
+    if (!watch->removed)
+    {
+        watch->thread = g_thread_self ();
+        g_mutex_unlock (dispatcher->mutex);
+
+        watch->func (watch->data);
+
+        g_mutex_lock (dispatcher->mutex);
+        watch->thread = NULL;
+    }
+    watch->running = FALSE;
+
+    if (watch->free_on_return)
+    {
+        watch->loop->dead = g_list_prepend (watch->loop->dead, watch);
+    }
+    else if (!watch->removed)
+    {
+        struct epoll_event event;
+
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = watch;
+        epoll_ctl (watch->loop->epoll_fd, EPOLL_CTL_MOD, watch->fd, &event);
+    }
+
+    g_cond_broadcast (dispatcher->condition);
+    g_mutex_unlock (dispatcher->mutex);
+}
+
+static gpointer
+loop_thread (gpointer data)
+{
+    Loop *loop;
+    Dispatcher *dispatcher;
+    struct epoll_event events[MAX_EVENTS];
+    gboolean quit = FALSE;
+
+    loop = data;
+    dispatcher = loop->dispatcher;
+
+    while (!quit)
+    {
+        gint n;
+        gint i;
+
+        n = epoll_wait (loop->epoll_fd, events, MAX_EVENTS, -1);
+
+        if (n < 0 && errno != EINTR)
+        {
+            g_warning ("epoll_wait failed: %d\n", errno);
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            Watch *watch;
+
+            watch = events[i].data.ptr;
+
+            if (!watch)
+            {
+                eventfd_t value;
+                eventfd_read (loop->wakeup_fd, &value);
+                continue;
+            }
+
+            /* The callback may block, e.g. pushing downstream; it must
+             * not hold up the other descriptors of this loop. */
+            g_mutex_lock (dispatcher->mutex);
+            if (!watch->removed)
+            {
+                watch->running = TRUE;
+                g_thread_pool_push (dispatcher->pool, watch, NULL);
+            }
+            g_mutex_unlock (dispatcher->mutex);
+        }
+
+        /* Nothing from this round refers to them anymore. */
+        g_mutex_lock (dispatcher->mutex);
+        {
+            GList *l;
+            for (l = loop->dead; l; l = l->next)
+                g_free (l->data);
+            g_list_free (loop->dead);
+            loop->dead = NULL;
+        }
+        quit = loop->quit;
+        g_mutex_unlock (dispatcher->mutex);
+    }
+
+    return NULL;
+}
+
+Dispatcher *
+dispatcher_new (guint n_threads)
+{
+    Dispatcher *dispatcher;
+    guint i;
+
+    dispatcher = g_new0 (Dispatcher, 1);
+    dispatcher->mutex = g_mutex_new ();
+    dispatcher->condition = g_cond_new ();
+    dispatcher->watches = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+    dispatcher->n_loops = MAX (n_threads, 1);
+    dispatcher->loops = g_new0 (Loop, dispatcher->n_loops);
+
+    /* Grows with the callbacks that block at the same time. */
+    dispatcher->pool = g_thread_pool_new (run_watch, dispatcher, -1, FALSE, NULL);
+
+    for (i = 0; i < dispatcher->n_loops; i++)
+    {
+        Loop *loop;
+        struct epoll_event event;
+
+        loop = &dispatcher->loops[i];
+        loop->dispatcher = dispatcher;
+        loop->epoll_fd = epoll_create (MAX_EVENTS);
+        loop->wakeup_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (loop->epoll_fd < 0 || loop->wakeup_fd < 0)
+        {
+            g_warning ("couldn't create dispatcher loop\n");
+            dispatcher->n_loops = i;
+            dispatcher_free (dispatcher);
+            return NULL;
+        }
+
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_fd, &event);
+
+        loop->thread = g_thread_create (loop_thread, loop, TRUE, NULL);
+    }
+
+    return dispatcher;
+}
+
+void
+dispatcher_free (Dispatcher *dispatcher)
+{
+    guint i;
+
+    for (i = 0; i < dispatcher->n_loops; i++)
+    {
+        Loop *loop;
+
+        loop = &dispatcher->loops[i];
+
+        g_mutex_lock (dispatcher->mutex);
+        loop->quit = TRUE;
+        g_mutex_unlock (dispatcher->mutex);
+
+        eventfd_write (loop->wakeup_fd, 1);
+        g_thread_join (loop->thread);
+    }
+
+    /* Lets the callbacks in progress finish; they may add to dead. */
+    g_thread_pool_free (dispatcher->pool, FALSE, TRUE);
+
+    for (i = 0; i < dispatcher->n_loops; i++)
+    {
+        Loop *loop;
+
+        loop = &dispatcher->loops[i];
+
+        {
+            GList *l;
+            for (l = loop->dead; l; l = l->next)
+                g_free (l->data);
+            g_list_free (loop->dead);
+        }
+
+        close (loop->wakeup_fd);
+        close (loop->epoll_fd);
+    }
+
+    g_hash_table_destroy (dispatcher->watches);
+
+    g_cond_free (dispatcher->condition);
+    g_mutex_free (dispatcher->mutex);
+
+    g_free (dispatcher->loops);
+    g_free (dispatcher);
+}
+
+/**
+ * Calls func whenever fd becomes readable; func must make it unreadable
+ * again, or it's called right back. func runs on a thread of a pool shared
+ * by all the descriptors, and may block; it's never called again before
+ * it returns. Adding a descriptor that is already there does nothing.
+ */
+gboolean
+dispatcher_add (Dispatcher *dispatcher,
+                gint fd,
+                DispatcherFunc func,
+                gpointer data)
+{
+    Watch *watch;
+    struct epoll_event event;
+    gboolean ret = TRUE;
+
+    g_mutex_lock (dispatcher->mutex);
+
+    if (g_hash_table_lookup (dispatcher->watches, GINT_TO_POINTER (fd)))
+        goto leave;
+
+    watch = g_new0 (Watch, 1);
+    watch->fd = fd;
+    watch->func = func;
+    watch->data = data;
+    watch->loop = &dispatcher->loops[dispatcher->next_loop++ % dispatcher->n_loops];
+
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = watch;
+
+    if (epoll_ctl (watch->loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        g_free (watch);
+        ret = FALSE;
+        goto leave;
+    }
+
+    g_hash_table_insert (dispatcher->watches, GINT_TO_POINTER (fd), watch);
+
+leave:
+    g_mutex_unlock (dispatcher->mutex);
+
+    return ret;
+}
+
+/**
+ * After this returns the callback for fd is not running, and won't be
+ * called again; unless this is called from that very callback.
+ */
+void
+dispatcher_remove (Dispatcher *dispatcher,
+                   gint fd)
+{
+    Watch *watch;
+
+    g_mutex_lock (dispatcher->mutex);
+
+    watch = g_hash_table_lookup (dispatcher->watches, GINT_TO_POINTER (fd));
+    if (!watch)
+        goto leave;
+
+    g_hash_table_steal (dispatcher->watches, GINT_TO_POINTER (fd));
+    watch->removed = TRUE;
+
+    epoll_ctl (watch->loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+    /* From its own callback; run_watch frees it once that returns. */
+    if (watch->thread == g_thread_self ())
+    {
+        watch->free_on_return = TRUE;
+        goto leave;
+    }
+
+    while (watch->running)
+        g_cond_wait (dispatcher->condition, dispatcher->mutex);
+
+    watch->loop->dead = g_list_prepend (watch->loop->dead, watch);
+
+leave:
+    g_mutex_unlock (dispatcher->mutex);
+}
+
+#else
+
+Dispatcher *
+dispatcher_new (guint n_threads)
+{
+    return NULL;
+}
+
+void
+dispatcher_free (Dispatcher *dispatcher)
+{
+}
+
+gboolean
+dispatcher_add (Dispatcher *dispatcher,
+                gint fd,
+                DispatcherFunc func,
+                gpointer data)
+{
+    return FALSE;
+}
+
+void
+dispatcher_remove (Dispatcher *dispatcher,
+                   gint fd)
+{
+}
+
+#endif /* HAVE_SYS_EPOLL_H && HAVE_SYS_EVENTFD_H */
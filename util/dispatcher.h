@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <glib.h>
+
+/*
+ * A few threads waiting on many file descriptors, and calling back whenever
+ * one becomes readable. The callbacks run on a shared pool of threads, so
+ * one that blocks holds up only its own descriptor. Callbacks for the same
+ * descriptor never run concurrently.
+ */
+
+typedef struct Dispatcher Dispatcher;
+typedef void (*DispatcherFunc) (gpointer data);
+
+Dispatcher *dispatcher_new (guint n_threads);
+void dispatcher_free (Dispatcher *dispatcher);
+gboolean dispatcher_add (Dispatcher *dispatcher, gint fd, DispatcherFunc func, gpointer data);
+void dispatcher_remove (Dispatcher *dispatcher, gint fd);
+
+#endif /* DISPATCHER_H */
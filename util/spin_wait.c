@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "spin_wait.h"
+
+#define SPIN_FLOOR 16
+
+static inline void
+cpu_relax (void)
+{
+#if defined (__i386__) || defined (__x86_64__)
+    __asm__ __volatile__ ("pause" ::: "memory");
+#elif defined (__arm__) && defined (__ARM_ARCH_7A__)
+    __asm__ __volatile__ ("yield" ::: "memory");
+#else
+    __asm__ __volatile__ ("" ::: "memory");
+#endif
+}
+
+void
+spin_wait_init (SpinWait *spin,
+                guint max)
+{
+    spin->max = max;
+    spin->budget = max;
+}
+
+/**
+ * Calls ready until it returns TRUE, for at most the current budget.
+ * Returns FALSE if the caller has to block after all.
+ *
+ * The budget is only a hint, so concurrent waiters may race on it.
+ */
+gboolean
+spin_wait (SpinWait *spin,
+           SpinWaitFunc ready,
+           gpointer data)
+{
+    guint budget;
+    guint i;
+
+    budget = spin->budget;
+
+    for (i = 0; i < budget; i++)
+    {
+        if (ready (data))
+        {
+            if (i * 2 > budget)
+                spin->budget = MIN (budget * 2, spin->max);
+            return TRUE;
+        }
+
+        cpu_relax ();
+    }
+
+    if (budget > 0)
+        spin->budget = MAX (budget / 2, MIN (spin->max, SPIN_FLOOR));
+
+    return FALSE;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef SPIN_WAIT_H
+#define SPIN_WAIT_H
+
+#include <glib.h>
+
+/*
+ * Busy-waiting for a condition before going to sleep on it. The number of
+ * iterations adapts between a small floor and max: it grows while the
+ * condition tends to come true late in the spin, and shrinks every time
+ * the whole budget is wasted.
+ */
+
+typedef struct SpinWait SpinWait;
+typedef gboolean (*SpinWaitFunc) (gpointer data);
+
+struct SpinWait
+{
+    guint max; /**< 0 disables spinning. */
+    guint budget;
+};
+
+void spin_wait_init (SpinWait *spin, guint max);
+gboolean spin_wait (SpinWait *spin, SpinWaitFunc ready, gpointer data);
+
+#endif /* SPIN_WAIT_H */
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "wait_stats.h"
+
+/** Accounts for a wait that began at start and ended now. */
+void
+wait_stats_add (WaitStats *stats,
+                const GTimeVal *start)
+{
+    GTimeVal now;
+    gint64 elapsed;
+    guint bucket;
+
+    g_get_current_time (&now);
+
+    elapsed = (gint64) (now.tv_sec - start->tv_sec) * G_USEC_PER_SEC +
+        (now.tv_usec - start->tv_usec);
+
+    if (elapsed < 0)
+        elapsed = 0;
+
+    for (bucket = 0;
+         bucket < WAIT_STATS_BUCKETS - 1 && elapsed >= ((gint64) 1 << bucket);
+         bucket++);
+
+    stats->count++;
+    stats->time += elapsed;
+    stats->histogram[bucket]++;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2008 Nokia Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef WAIT_STATS_H
+#define WAIT_STATS_H
+
+#include <glib.h>
+
+#define WAIT_STATS_BUCKETS 16
+
+typedef struct WaitStats WaitStats;
+
+/*
+ * How often and for how long a thread had to block. Bucket n of histogram
+ * counts waits shorter than 2^n microseconds; the last one counts all the
+ * longer ones too. Updated by the waiter with its lock held.
+ */
+struct WaitStats
+{
+    guint count;
+    guint64 time; /**< Microseconds. */
+    guint histogram[WAIT_STATS_BUCKETS];
+};
+
+void wait_stats_add (WaitStats *stats, const GTimeVal *start);
+
+#endif /* WAIT_STATS_H */